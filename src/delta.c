@@ -17,196 +17,631 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
+#include <float.h>
+#include <math.h>
+#include <string.h>
 #include <gst/gst.h>
 #include "delta.h"
 
-gint8 *process8 (void* buf, gint n_samples, gint nch, gfloat gain)
+/* The kernels are generated from the templates below, one per sample type.
+ *
+ * Without emphasis, walking the buffer backwards lets every sample be
+ * computed from itself and the sample one frame earlier, which has not
+ * been overwritten yet, so no history has to be carried from frame to
+ * frame and the loop has no dependencies between iterations for the
+ * compiler to trip over.  The first frame is left as it is, as before.
+ *
+ * With emphasis the biquads need the previous output, so that loop runs
+ * forwards, one frame at a time, with all filter state in per channel
+ * arrays.  The channel loop then has no dependencies and the compiler can
+ * run the channels of a frame side by side.  The same loop without any
+ * biquads carries the history over for a continuous DeltaEmphasis, so the
+ * first frame of a buffer is sharpened from the last one of the buffer
+ * before.  Dither runs in the same loop when there is emphasis or noise
+ * shaping, which needs the error of the previous frame, with generators
+ * per channel too.  Plain TPDF dither runs in the backward loop, with
+ * noise hashed from the position of each sample instead.
+ *
+ * Each kernel is split into loops for every clip mode and for whether
+ * there are biquad stages, so those are decided once per buffer and not
+ * per sample.  The dithered loops are split more coarsely, see
+ * FORWARD_LOOP_STAGES.
+ *
+ * When the channels have gains of their own, the plain loop still runs
+ * over all channels at once, with a gain per sample from a table that
+ * repeats the channel gains, and leaves the inactive channels as they
+ * were.  The forward loop walks the list of active channels.  When
+ * every channel is active with the same gain the kernels take the
+ * contiguous loops above, as they do for a single gain. */
+
+/* The loops are specialised by calling them with constant arguments, which
+ * only works when every call is inlined.  Left to itself the compiler
+ * stops inlining the larger loops once the file has grown enough, and
+ * those calls then run a generic loop that does not vectorise. */
+#ifdef __GNUC__
+#define KERNEL_LOOP static inline __attribute__ ((always_inline))
+#else
+#define KERNEL_LOOP static inline
+#endif
+
+#define SATURATE(type, x, lo, hi) ((type) CLAMP ((x), (lo), (hi)))
+/* (gdouble) G_MAXINT64 rounds up to 2^63 (G_MAXUINT64 to 2^64), which does
+ * not fit in the type any more */
+#define SATURATE64(type, x, lo, hi) \
+  (((x) >= (gdouble) (hi)) ? (hi) : (type) MAX ((x), (gdouble) (lo)))
+/* Soft clipped samples are within rounding of full scale, which the cast
+ * truncates back into range, except for the 64 bit types whose full scale
+ * rounds up to 2^63 in gdouble. */
+#define SATURATE_SOFT(type, x, lo, hi) ((type) (x))
+#define SATURATE64_SOFT(type, x, lo, hi) SATURATE64 (type, x, lo, hi)
+
+/* Bend samples whose distance from center is above knee with a parabola
+ * that meets full scale (knee + width / 2) with zero slope after width,
+ * and flatten everything past that.  Samples below the knee come out
+ * unchanged, bit for bit, and nothing comes out past full scale.  The
+ * result is built from the bent distance instead of by taking the bend
+ * off x, which cancels to nothing for samples far past full scale and to
+ * NaN for infinite ones.  NaN passes through, as it does through the hard
+ * clip.  There are no branches or divisions, only a select, so the
+ * compiler is free to keep it in the same loop as the hard clip. */
+static inline gdouble
+soft_clip (gdouble x, gdouble center, gdouble knee, gdouble width)
 {
-  gdouble prevSample[nch];
-  gint8 *samples = (gint8*)buf;
-
-  for (int i = 0; i < nch; i++) 
-      prevSample[i] = (gdouble)samples[i];
-
-  for (int i = nch; i < n_samples; i+=nch) {
-    for (int j = 0; j < nch; j++) {
-      gdouble curr_sample = (gdouble)samples[i+j];
-      gdouble result = curr_sample+(gain*(curr_sample-prevSample[j]));
-      prevSample[j] = (gdouble) samples[i+j];
-      samples[i+j] = (gint8) CLAMP(result, G_MININT8, G_MAXINT8);
-    }
-  }
-  return samples;
+  gdouble dev = x - center;
+  gdouble bent = MIN (fabs (dev) - knee, width);
+
+  return fabs (dev) > knee ?
+      center + copysign (knee + bent - bent * bent * (0.5 / width), dev) : x;
 }
 
-guint8 *process8u (void* buf, gint n_samples, gint nch, gfloat gain)
+static inline gfloat
+soft_clipf (gfloat x, gfloat center, gfloat knee, gfloat width)
 {
-  gdouble prevSample[nch];
-  guint8 *samples = (guint8*)buf;
-
-  for (int i = 0; i < nch; i++) 
-      prevSample[i] = (gdouble)samples[i];
-	
-  for (int i = nch; i < n_samples; i+=nch) {
-    for (int j = 0; j < nch; j++) {
-      gdouble curr_sample = (gdouble) samples[i+j];
-      gdouble result = curr_sample+(gain*(curr_sample-prevSample[j]));
-      prevSample[j] = (gdouble) samples[i+j];
-      samples[i+j] = (guint8) CLAMP(result, 0, G_MAXUINT8);
-    }
-  }
-  return samples;
+  gfloat dev = x - center;
+  gfloat bent = MIN (fabsf (dev) - knee, width);
+
+  return fabsf (dev) > knee ?
+      center + copysignf (knee + bent - bent * bent * (0.5f / width), dev) :
+      x;
 }
 
-gint16 *process16 (void* buf, gint n_samples, gint nch, gfloat gain)
+/* One step of a xorshift32 generator, turned into triangular noise of
+ * +-1 LSB by adding its two 16 bit halves. */
+static inline gdouble
+tpdf_noise (guint32 *state)
 {
-  gdouble prevSample[nch];
-  gint16 *samples = (gint16*)buf;
-
-  for (int i = 0; i < nch; i++) 
-      prevSample[i] = (gdouble)samples[i];
-
-  for (int i = nch; i < n_samples; i+=nch) {
-    for (int j = 0; j < nch; j++) {
-      gdouble curr_sample = (gdouble)samples[i+j];
-      gdouble result = curr_sample+(gain*(curr_sample-prevSample[j]));
-      prevSample[j] = (gdouble) samples[i+j];
-      samples[i+j] = (gint16) CLAMP(result, G_MININT16, G_MAXINT16);
-    }
-  }
-  return samples;
+  guint32 r = *state;
+
+  r ^= r << 13;
+  r ^= r >> 17;
+  r ^= r << 5;
+  *state = r;
+
+  return ((gdouble) (r & 0xffff) + (gdouble) (r >> 16)) * (1.0 / 65536.0)
+      - 1.0;
 }
 
-guint16 *process16u (void* buf, gint n_samples, gint nch, gfloat gain)
+/* Noise of the same shape for the loops that do not visit the samples in
+ * order, from a hash (lowbias32) of the position of the sample in the
+ * stream instead of a generator that has to be stepped.  The halves and
+ * their sum are exact in gfloat, so both variants give the same noise. */
+static inline guint32
+position_hash (guint32 x)
 {
-  gdouble prevSample[nch];
-  guint16 *samples = (guint16*)buf;
-
-  for (int i = 0; i < nch; i++) 
-      prevSample[i] = (gdouble)samples[i];
-	
-  for (int i = nch; i < n_samples; i+=nch) {
-    for (int j = 0; j < nch; j++) {
-      gdouble curr_sample = (gdouble) samples[i+j];
-      gdouble result = curr_sample+(gain*(curr_sample-prevSample[j]));
-      prevSample[j] = (gdouble) samples[i+j];
-      samples[i+j] = (guint16) CLAMP(result, 0, G_MAXUINT16);
-    }
-  }
-  return samples;
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+
+  return x;
 }
 
-gint32 *process32 (void* buf, gint n_samples, gint nch, gfloat gain)
+static inline gdouble
+hashed_noise (guint32 index)
 {
-  gdouble prevSample[nch];
-  gint32 *samples = (gint32*)buf;
-
-  for (int i = 0; i < nch; i++) 
-      prevSample[i] = (gdouble)samples[i];
-
-  for (int i = nch; i < n_samples; i+=nch) {
-    for (int j = 0; j < nch; j++) {
-      gdouble curr_sample = (gdouble)samples[i+j];
-      gdouble result = curr_sample+(gain*(curr_sample-prevSample[j]));
-      prevSample[j] = (gdouble) samples[i+j];
-      samples[i+j] = (gint32) CLAMP(result, G_MININT32, G_MAXINT32);
-    }
-  }
-  return samples;
+  guint32 r = position_hash (index);
+
+  return ((gdouble) (gint32) (r & 0xffff) + (gdouble) (gint32) (r >> 16))
+      * (1.0 / 65536.0) - 1.0;
 }
 
-guint32 *process32u (void* buf, gint n_samples, gint nch, gfloat gain)
+static inline gfloat
+hashed_noisef (guint32 index)
 {
-  gdouble prevSample[nch];
-  guint32 *samples = (guint32*)buf;
-
-  for (int i = 0; i < nch; i++) 
-      prevSample[i] = (gdouble)samples[i];
-	
-  for (int i = nch; i < n_samples; i+=nch) {
-    for (int j = 0; j < nch; j++) {
-      gdouble curr_sample = (gdouble) samples[i+j];
-      gdouble result = curr_sample+(gain*(curr_sample-prevSample[j]));
-      prevSample[j] = (gdouble) samples[i+j];
-      samples[i+j] = (guint32) CLAMP(result, 0, G_MAXUINT32);
-    }
-  }
-  return samples;
+  guint32 r = position_hash (index);
+
+  return ((gfloat) (gint32) (r & 0xffff) + (gfloat) (gint32) (r >> 16))
+      * (1.0f / 65536.0f) - 1.0f;
 }
 
-gint64 *process64 (void* buf, gint n_samples, gint nch, gfloat gain)
+/* Round to the nearest integer.  Adding 1.5 * 2^52 leaves no bits below
+ * the units, which does the rounding in the FPU's own mode without a call
+ * to floor() or rint(), which the compiler will not inline everywhere.
+ * From 2^51 up the sum lands on even integers only, so those values are
+ * returned as they are: integers, or from 2^51 to 2^52 halves, which are
+ * within the rounding of the gdouble maths anyway.  The trick needs the sum
+ * rounded to gdouble, which x87 code (FLT_EVAL_METHOD 2) does not do, so
+ * that falls back to nearbyint(). */
+static inline gdouble
+round_nearest (gdouble x)
 {
-  gdouble prevSample[nch];
-  gint64 *samples = (gint64*)buf;
-
-  for (int i = 0; i < nch; i++) 
-      prevSample[i] = (gdouble)samples[i];
-
-  for (int i = nch; i < n_samples; i+=nch) {
-    for (int j = 0; j < nch; j++) {
-      gdouble curr_sample = (gdouble)samples[i+j];
-      gdouble result = curr_sample+(gain*(curr_sample-prevSample[j]));
-      prevSample[j] = (gdouble) samples[i+j];
-      samples[i+j] = (gint64) CLAMP(result, G_MININT64, G_MAXINT64);
-    }
-  }
-  return samples;
+#if FLT_EVAL_METHOD == 0 || FLT_EVAL_METHOD == 1
+  const gdouble magic = 6755399441055744.0;
+
+  return fabs (x) < 2251799813685248.0 ? (x + magic) - magic : x;
+#else
+  return nearbyint (x);
+#endif
 }
 
-guint64 *process64u (void* buf, gint n_samples, gint nch, gfloat gain)
+/* The same with 1.5 * 2^23, which needs gfloat sums rounded to gfloat */
+static inline gfloat
+round_nearestf (gfloat x)
 {
-  gdouble prevSample[nch];
-  guint64 *samples = (guint64*)buf;
-
-  for (int i = 0; i < nch; i++) 
-      prevSample[i] = (gdouble)samples[i];
-	
-  for (int i = nch; i < n_samples; i+=nch) {
-    for (int j = 0; j < nch; j++) {
-      gdouble curr_sample = (gdouble) samples[i+j];
-      gdouble result = curr_sample+(gain*(curr_sample-prevSample[j]));
-      prevSample[j] = (gdouble) samples[i+j];
-      samples[i+j] = (guint64) CLAMP(result, 0, G_MAXUINT64);
-    }
+#if FLT_EVAL_METHOD == 0
+  const gfloat magic = 12582912.0f;
+
+  return fabsf (x) < 4194304.0f ? (x + magic) - magic : x;
+#else
+  return nearbyintf (x);
+#endif
+}
+
+/* The forward loops compute the filters in gdouble for every sample type;
+ * full is the distance from center to full scale for the soft clip.
+ * Without filters they compute in the same types as the plain loops do,
+ * hard_ptype for the hard clip and ptype with plain_soft_clip otherwise, so
+ * carrying the history over gives the same samples the plain loop would.
+ * With dither the result is rounded to the nearest integer after adding
+ * the noise, instead of truncated by the cast. */
+#define FORWARD_LOOP_BODY(type, lo, hi, center, full, saturate, hard_ptype, \
+    ptype, plain_soft_clip, dithered, dither) \
+  const gdouble knee = DELTA_SOFT_CLIP_KNEE * (full); \
+  const gdouble width = 2.0 * ((full) - knee); \
+  const ptype plain_knee = knee; \
+  const ptype plain_width = width; \
+  const gint n_channels = indexed ? cg->n_active : nch; \
+ \
+  for (int i = 0; i <= n_samples - nch; i += nch) { \
+    if (n_stages == 0 && (soft || dithered)) { \
+      for (int k = 0; k < n_channels; k++) { \
+        int j = indexed ? cg->active[k] : k; \
+        gfloat g = indexed ? cg->gains[j] : gain; \
+        ptype curr_sample = (ptype)samples[i+j]; \
+        ptype result = curr_sample+(g*(curr_sample-(ptype)history[j])); \
+        history[j] = (gdouble)samples[i+j]; \
+        if (soft) \
+          result = plain_soft_clip (result, (center), plain_knee, \
+              plain_width); \
+        dither \
+        samples[i+j] = saturate (type, result, lo, hi); \
+      } \
+      continue; \
+    } \
+    if (n_stages == 0) { \
+      for (int k = 0; k < n_channels; k++) { \
+        int j = indexed ? cg->active[k] : k; \
+        gfloat g = indexed ? cg->gains[j] : gain; \
+        hard_ptype curr_sample = (hard_ptype)samples[i+j]; \
+        hard_ptype result = \
+            curr_sample+(g*(curr_sample-(hard_ptype)history[j])); \
+        history[j] = (gdouble)samples[i+j]; \
+        samples[i+j] = saturate (type, result, lo, hi); \
+      } \
+      continue; \
+    } \
+ \
+    /* one flat loop over the channels per step, so that no value is \
+     * carried from one stage to the next inside a channel loop */ \
+    for (int k = 0; k < n_channels; k++) { \
+      int j = indexed ? cg->active[k] : k; \
+      gdouble curr_sample = (gdouble)samples[i+j]; \
+      diff[j] = curr_sample - history[j]; \
+      history[j] = curr_sample; \
+    } \
+    for (int s = 0; s < n_stages; s++) { \
+      const gdouble b0 = bq[s].b0, b1 = bq[s].b1, b2 = bq[s].b2; \
+      const gdouble a1 = bq[s].a1, a2 = bq[s].a2; \
+      gdouble *restrict s1 = z1 + s * nch; \
+      gdouble *restrict s2 = z2 + s * nch; \
+      for (int k = 0; k < n_channels; k++) { \
+        int j = indexed ? cg->active[k] : k; \
+        gdouble out = b0 * diff[j] + s1[j]; \
+        s1[j] = b1 * diff[j] - a1 * out + s2[j]; \
+        s2[j] = b2 * diff[j] - a2 * out; \
+        diff[j] = out; \
+      } \
+    } \
+    for (int k = 0; k < n_channels; k++) { \
+      int j = indexed ? cg->active[k] : k; \
+      gfloat g = indexed ? cg->gains[j] : gain; \
+      gdouble filtered = (gdouble)samples[i+j]+(g*diff[j]); \
+      if (soft) \
+        filtered = soft_clip (filtered, (center), knee, width); \
+      ptype result = filtered; \
+      dither \
+      samples[i+j] = saturate (type, result, lo, hi); \
+    } \
   }
-  return samples;
+
+#define DITHER_RESULT \
+      { \
+        gdouble wanted = result; \
+        if (shaped) \
+          wanted -= error[j]; \
+        gdouble quantized = round_nearest (wanted + tpdf_noise (&rng[j])); \
+        if (shaped) \
+          error[j] = quantized - wanted; \
+        result = quantized; \
+      }
+
+#define DEFINE_FORWARD_LOOP(name, type, lo, hi, center, full, saturate, \
+    hard_ptype, ptype, plain_soft_clip) \
+KERNEL_LOOP void \
+name##_forward_loop (type *samples, gint n_samples, gint nch, gfloat gain, \
+    const DeltaChannelGains *cg, const gboolean indexed, gboolean soft, \
+    const DeltaBiquad *bq, const gint n_stages, gdouble *restrict history, \
+    gdouble *restrict z1, gdouble *restrict z2, gdouble *restrict diff) \
+{ \
+  FORWARD_LOOP_BODY (type, lo, hi, center, full, saturate, hard_ptype, \
+      ptype, plain_soft_clip, FALSE, ) \
+} \
+ \
+KERNEL_LOOP void \
+name##_dither_loop (type *samples, gint n_samples, gint nch, gfloat gain, \
+    const DeltaChannelGains *cg, const gboolean indexed, gboolean soft, \
+    const DeltaBiquad *bq, const gint n_stages, const gboolean shaped, \
+    guint32 *restrict rng, gdouble *restrict error, \
+    gdouble *restrict history, gdouble *restrict z1, gdouble *restrict z2, \
+    gdouble *restrict diff) \
+{ \
+  FORWARD_LOOP_BODY (type, lo, hi, center, full, saturate, hard_ptype, \
+      ptype, plain_soft_clip, TRUE, DITHER_RESULT) \
 }
 
-gfloat *processf (void* buf, gint n_samples, gint nch, gfloat gain)
-{
-  gfloat prevSample[nch];
-  gfloat *samples = (gfloat*)buf;
-
-  for (int i = 0; i < nch; i++) 
-      prevSample[i] = samples[i];
-
-  for (int i = nch; i < n_samples; i+=nch) {
-    gfloat result;
-    for (int j = 0; j < nch; j++) {
-      result = samples[i+j]+(gain*(samples[i+j]-prevSample[j]));
-      prevSample[j] = (gdouble) samples[i+j];
-      samples[i+j] = (gfloat) CLAMP(result, -G_MAXFLOAT, G_MAXFLOAT);
-    }
+#define FORWARD_LOOP(name, indexed, soft, n_stages) \
+  name##_forward_loop (start, n_samples, channels, gain, channel_gains, \
+      indexed, soft, stages, n_stages, history, z1, z2, diff)
+
+#define DITHER_LOOP(name, indexed, shaped, n_stages) \
+  name##_dither_loop (start, n_samples, channels, gain, channel_gains, \
+      indexed, soft, stages, n_stages, shaped, dither->rng, dither->error, \
+      history, z1, z2, diff)
+
+/* The forward loop is specialised on everything that changes its inner
+ * loop: the active channels, the clip mode and whether there are biquads.
+ * Their number only sets how often the stage loop runs.  Stereo filters
+ * also get a loop with the channel count fixed, where the per-stage
+ * channel loops become straight vector code instead of loops too short to
+ * pay for their setup.  Indexed channels keep the biquads at run time.
+ * Dithered loops are specialised on the shaping, the biquads and stereo
+ * filters the same way, and decide the rest per sample. */
+#define FORWARD_LOOP_STAGES(name, indexed, soft) \
+  do { \
+    if (n_stages == 0) \
+      FORWARD_LOOP (name, indexed, soft, 0); \
+    else \
+      FORWARD_LOOP (name, indexed, soft, n_stages); \
+  } while (0)
+
+#define DITHER_LOOP_STAGES(name, shaped) \
+  do { \
+    if (n_stages == 0) { \
+      DITHER_LOOP (name, FALSE, shaped, 0); \
+    } else if (nch == 2) { \
+      const gint channels = 2; \
+      DITHER_LOOP (name, FALSE, shaped, n_stages); \
+    } else { \
+      DITHER_LOOP (name, FALSE, shaped, n_stages); \
+    } \
+  } while (0)
+
+/* The plain loops walk the buffer backwards and leave the first frame
+ * alone, which lets every sample be computed from the one a frame earlier
+ * before that is overwritten.  With channel gains they go over the buffer
+ * in blocks from the last one down, each block being the lanes of the
+ * channel gains, a whole number of frames.  The gain of sample i is then
+ * lanes[start + block - 1 - i], so the inner loop runs over all channels
+ * at once with nothing but contiguous loads, and the inactive channels
+ * keep their input.  The lanes run from the end of the block so that they
+ * are read forwards: gcc does not vectorise reversed gfloat loads in a
+ * loop over 8 or 16 bit samples. */
+#define PLAIN_LOOP_BODY(name, type) \
+  if (!indexed) { \
+    for (int i = n_samples - 1; i >= nch; i--) \
+      samples[i] = name##_sample (samples, i, nch, gain, soft, dithered, \
+          index); \
+  } else { \
+    const gfloat *lanes = cg->lanes; \
+    const gint block = cg->n_lanes; \
+ \
+    for (int start = (n_samples - 1) / block * block; start >= 0; \
+        start -= block) { \
+      for (int i = MIN (start + block, n_samples) - 1; \
+          i >= MAX (start, nch); i--) { \
+        gfloat g = lanes[start + block - 1 - i]; \
+        type out = name##_sample (samples, i, nch, g, soft, dithered, \
+            index); \
+        samples[i] = g != 0.0f ? out : samples[i]; \
+      } \
+    } \
   }
-  return samples;
+
+/* The plain loop is specialised on the channel gains, the clip mode and
+ * plain TPDF dither, which needs nothing but the position of each sample
+ * in the stream. */
+#define PLAIN_LOOP(name, indexed) \
+  do { \
+    if (dithered && soft) \
+      name##_loop (samples, n_samples, nch, gain, channel_gains, indexed, \
+          TRUE, TRUE, index); \
+    else if (dithered) \
+      name##_loop (samples, n_samples, nch, gain, channel_gains, indexed, \
+          FALSE, TRUE, index); \
+    else if (soft) \
+      name##_loop (samples, n_samples, nch, gain, channel_gains, indexed, \
+          TRUE, FALSE, 0); \
+    else \
+      name##_loop (samples, n_samples, nch, gain, channel_gains, indexed, \
+          FALSE, FALSE, 0); \
+  } while (0)
+
+/* Pick the loop for this buffer.
+ *
+ * The forward loop runs when an emphasis filters or carries the history,
+ * or when the dither is shaped.  The first frame ever seen by an emphasis
+ * starts its history, which keeps it unprocessed like the plain loop
+ * does.  Shaped dither alone keeps its own history, started over from the
+ * first frame of every buffer as the plain loop would.  The dither
+ * position moves on by the whole buffer, whichever loop runs. */
+#define DEFINE_PROCESS_DISPATCH(name, type, can_dither) \
+gpointer name (void* buf, gint n_samples, gint nch, gfloat gain, \
+    const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, \
+    DeltaEmphasis *emphasis, DeltaDither *dither) \
+{ \
+  type *samples = (type*)buf; \
+  gboolean soft = (clip_mode == DELTA_CLIP_SOFT); \
+  gboolean indexed = FALSE; \
+  gboolean use_emphasis = emphasis != NULL && \
+      (emphasis->n_stages > 0 || emphasis->continuous); \
+  DeltaDitherMode dither_mode = DELTA_DITHER_NONE; \
+  guint32 index = 0; \
+ \
+  if ((can_dither) && dither != NULL && dither->channels == nch) { \
+    dither_mode = dither->mode; \
+    index = dither->position; \
+    dither->position += (guint32) n_samples; \
+  } \
+  gboolean dithered = dither_mode == DELTA_DITHER_TPDF && !use_emphasis; \
+ \
+  if (channel_gains != NULL && channel_gains->channels == nch) { \
+    if (channel_gains->n_active == 0) \
+      return samples; \
+    if (channel_gains->uniform) \
+      gain = channel_gains->gains[0]; \
+    else \
+      indexed = TRUE; \
+  } \
+ \
+  if (!use_emphasis && dither_mode != DELTA_DITHER_TPDF_SHAPED) { \
+    if (indexed) \
+      PLAIN_LOOP (name, TRUE); \
+    else \
+      PLAIN_LOOP (name, FALSE); \
+    return samples; \
+  } \
+ \
+  type *start = samples; \
+  gdouble *history; \
+  if (use_emphasis) { \
+    history = emphasis->history; \
+    if (!emphasis->primed) { \
+      if (n_samples < nch) \
+        return samples; \
+      for (int j = 0; j < nch; j++) \
+        history[j] = (gdouble)samples[j]; \
+      emphasis->primed = TRUE; \
+      start += nch; \
+      n_samples -= nch; \
+    } \
+  } else { \
+    history = dither->history; \
+    if (n_samples < nch) \
+      return samples; \
+    for (int j = 0; j < nch; j++) \
+      history[j] = (gdouble)samples[j]; \
+    start += nch; \
+    n_samples -= nch; \
+  } \
+ \
+  const DeltaBiquad *stages = use_emphasis ? emphasis->stages : NULL; \
+  const gint n_stages = use_emphasis ? emphasis->n_stages : 0; \
+  gdouble *z1 = use_emphasis ? emphasis->z1 : NULL; \
+  gdouble *z2 = use_emphasis ? emphasis->z2 : NULL; \
+  gdouble *diff = use_emphasis ? emphasis->diff : NULL; \
+  const gint channels = nch; \
+ \
+  if (dither_mode != DELTA_DITHER_NONE) { \
+    if (indexed) \
+      DITHER_LOOP (name, TRUE, dither_mode == DELTA_DITHER_TPDF_SHAPED, \
+          n_stages); \
+    else if (dither_mode == DELTA_DITHER_TPDF_SHAPED) \
+      DITHER_LOOP_STAGES (name, TRUE); \
+    else \
+      DITHER_LOOP_STAGES (name, FALSE); \
+  } else if (indexed) { \
+    if (soft) \
+      FORWARD_LOOP (name, TRUE, TRUE, n_stages); \
+    else \
+      FORWARD_LOOP (name, TRUE, FALSE, n_stages); \
+  } else if (nch == 2 && n_stages > 0) { \
+    const gint channels = 2; \
+    if (soft) \
+      FORWARD_LOOP (name, FALSE, TRUE, n_stages); \
+    else \
+      FORWARD_LOOP (name, FALSE, FALSE, n_stages); \
+  } else { \
+    if (soft) \
+      FORWARD_LOOP_STAGES (name, FALSE, TRUE); \
+    else \
+      FORWARD_LOOP_STAGES (name, FALSE, FALSE); \
+  } \
+  return samples; \
 }
 
-gdouble *processd (void* buf, gint n_samples, gint nch, gfloat gain)
+/* The plain loops compute each sample i with name##_sample, see
+ * PLAIN_LOOP_BODY.  The hard clip computes in gdouble, where the result of
+ * every integer type is exact before the cast truncates it.  The soft
+ * clip and the dither compute in ptype instead: gfloat for 8 and 16 bit
+ * samples lets the compiler convert them in vectors, which it will not do
+ * between short integers and gdouble, at the cost of results within
+ * gfloat rounding of an integer landing on its neighbour.  Wider types
+ * need gdouble.  Full scale for the soft clip is the distance from center
+ * to hi.  Dithered samples go through the full saturation as the noise
+ * can take them past full scale.  index is the position of samples[0] in
+ * the stream. */
+#define DEFINE_INT_PROCESS(name, type, lo, hi, center, saturate, ptype, \
+    soft_clip_func, round_func, noise_func) \
+KERNEL_LOOP type \
+name##_sample (const type *samples, int i, gint nch, gfloat g, \
+    gboolean soft, const gboolean dithered, guint32 index) \
+{ \
+  const ptype knee = DELTA_SOFT_CLIP_KNEE * ((gdouble) (hi) - (center)); \
+  const ptype width = 2.0 * (((gdouble) (hi) - (center)) - \
+      DELTA_SOFT_CLIP_KNEE * ((gdouble) (hi) - (center))); \
+ \
+  if (!soft && !dithered) { \
+    gdouble curr_sample = (gdouble)samples[i]; \
+    gdouble result = curr_sample+(g*(curr_sample-(gdouble)samples[i-nch])); \
+    return saturate (type, result, lo, hi); \
+  } \
+  ptype curr_sample = (ptype)samples[i]; \
+  ptype result = curr_sample+(g*(curr_sample-(ptype)samples[i-nch])); \
+  if (soft) \
+    result = soft_clip_func (result, (center), knee, width); \
+  if (dithered) \
+    result = round_func (result + noise_func (index + (guint32) i)); \
+  if (soft && !dithered) \
+    return saturate##_SOFT (type, result, lo, hi); \
+  return saturate (type, result, lo, hi); \
+} \
+ \
+KERNEL_LOOP void \
+name##_loop (type *samples, gint n_samples, gint nch, gfloat gain, \
+    const DeltaChannelGains *cg, const gboolean indexed, gboolean soft, \
+    const gboolean dithered, guint32 index) \
+{ \
+  PLAIN_LOOP_BODY (name, type); \
+} \
+ \
+DEFINE_FORWARD_LOOP (name, type, lo, hi, center, \
+    (gdouble) (hi) - (center), saturate, gdouble, ptype, soft_clip_func) \
+DEFINE_PROCESS_DISPATCH (name, type, TRUE)
+
+/* Float samples are processed in their own type, full scale is 1.0, and
+ * there is nothing to dither, so dithered and index are ignored */
+#define DEFINE_FLOAT_PROCESS(name, type, maxval, soft_clip_func) \
+KERNEL_LOOP type \
+name##_sample (const type *samples, int i, gint nch, gfloat g, \
+    gboolean soft, const gboolean dithered, guint32 index) \
+{ \
+  const type knee = DELTA_SOFT_CLIP_KNEE; \
+  const type width = 2.0 * (1.0 - DELTA_SOFT_CLIP_KNEE); \
+  type result = samples[i]+(g*(samples[i]-samples[i-nch])); \
+ \
+  /* the soft clip stays within full scale by itself */ \
+  if (soft) \
+    return soft_clip_func (result, 0.0, knee, width); \
+  return (type) CLAMP(result, -(maxval), (maxval)); \
+} \
+ \
+KERNEL_LOOP void \
+name##_loop (type *samples, gint n_samples, gint nch, gfloat gain, \
+    const DeltaChannelGains *cg, const gboolean indexed, gboolean soft, \
+    const gboolean dithered, guint32 index) \
+{ \
+  PLAIN_LOOP_BODY (name, type); \
+} \
+ \
+DEFINE_FORWARD_LOOP (name, type, -(maxval), (maxval), 0.0, 1.0, SATURATE, \
+    type, type, soft_clip_func) \
+DEFINE_PROCESS_DISPATCH (name, type, FALSE)
+
+DEFINE_INT_PROCESS (process8, gint8, G_MININT8, G_MAXINT8, 0.0, SATURATE,
+    gfloat, soft_clipf, round_nearestf, hashed_noisef)
+DEFINE_INT_PROCESS (process8u, guint8, 0, G_MAXUINT8, 128.0, SATURATE,
+    gfloat, soft_clipf, round_nearestf, hashed_noisef)
+DEFINE_INT_PROCESS (process16, gint16, G_MININT16, G_MAXINT16, 0.0, SATURATE,
+    gfloat, soft_clipf, round_nearestf, hashed_noisef)
+DEFINE_INT_PROCESS (process16u, guint16, 0, G_MAXUINT16, 32768.0, SATURATE,
+    gfloat, soft_clipf, round_nearestf, hashed_noisef)
+DEFINE_INT_PROCESS (process32, gint32, G_MININT32, G_MAXINT32, 0.0, SATURATE,
+    gdouble, soft_clip, round_nearest, hashed_noise)
+DEFINE_INT_PROCESS (process32u, guint32, 0, G_MAXUINT32, 2147483648.0,
+    SATURATE, gdouble, soft_clip, round_nearest, hashed_noise)
+DEFINE_INT_PROCESS (process64, gint64, G_MININT64, G_MAXINT64, 0.0, SATURATE64,
+    gdouble, soft_clip, round_nearest, hashed_noise)
+DEFINE_INT_PROCESS (process64u, guint64, 0, G_MAXUINT64,
+    9223372036854775808.0, SATURATE64, gdouble, soft_clip, round_nearest,
+    hashed_noise)
+DEFINE_FLOAT_PROCESS (processf, gfloat, G_MAXFLOAT, soft_clipf)
+DEFINE_FLOAT_PROCESS (processd, gdouble, G_MAXDOUBLE, soft_clip)
+
+void delta_channel_gains_init (DeltaChannelGains *cg)
 {
-  gdouble prevSample[nch];
-  gdouble *samples = (gdouble*)buf;
-
-  for (int i = 0; i < nch; i++) 
-      prevSample[i] = samples[i];
-
-  for (int i = nch; i < n_samples; i+=nch) {
-    gdouble result;
-    for (int j = 0; j < nch; j++) {
-      result = samples[i+j]+(gain*(samples[i+j]-prevSample[j]));
-      prevSample[j] = samples[i+j];
-      samples[i+j] = (gdouble) CLAMP(result, -G_MAXDOUBLE, G_MAXDOUBLE);
+  memset (cg, 0, sizeof (DeltaChannelGains));
+}
+
+void delta_channel_gains_clear (DeltaChannelGains *cg)
+{
+  g_free (cg->gains);
+  g_free (cg->active);
+  g_free (cg->lanes);
+  delta_channel_gains_init (cg);
+}
+
+/* The lanes are a whole number of frames and of 16 samples, so that the
+ * vector loops over a block need no remainder, and at least this many
+ * samples, so that the setup of each block is paid for. */
+#define CHANNEL_GAIN_LANES 256
+
+/* Channels past the end of gains get the default gain.  Returns TRUE when
+ * the set of active channels changed. */
+gboolean delta_channel_gains_set (DeltaChannelGains *cg, gint channels,
+    gfloat gain, const gfloat *gains, gint n_gains)
+{
+  gboolean changed = FALSE;
+  gint n_active = 0;
+
+  if (cg->channels != channels) {
+    delta_channel_gains_clear (cg);
+    cg->channels = channels;
+    cg->gains = g_new0 (gfloat, channels);
+    cg->active = g_new0 (gint, channels);
+    while (channels > 0 && (cg->n_lanes < CHANNEL_GAIN_LANES ||
+            cg->n_lanes % 16 != 0))
+      cg->n_lanes += channels;
+    cg->lanes = g_new0 (gfloat, cg->n_lanes);
+    changed = TRUE;
+  }
+
+  cg->uniform = TRUE;
+  for (int j = 0; j < channels; j++) {
+    cg->gains[j] = (j < n_gains) ? gains[j] : gain;
+    if (cg->gains[j] != 0.0f) {
+      changed |= (n_active >= cg->n_active || cg->active[n_active] != j);
+      cg->active[n_active++] = j;
     }
+    cg->uniform &= (cg->gains[j] == cg->gains[0]);
   }
-  return samples;
-}
+  changed |= (n_active != cg->n_active);
+  cg->n_active = n_active;
+  cg->uniform &= (n_active == channels);
+
+  /* from the last sample of a block back, see PLAIN_LOOP_BODY */
+  for (int l = 0; l < cg->n_lanes; l++)
+    cg->lanes[l] = cg->gains[(cg->n_lanes - 1 - l) % channels];
 
+  return changed;
+}
@@ -17,16 +17,59 @@
     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include "emphasis.h"
+#include "dither.h"
+
 #define DLT_NEED_CLAMP(x, low, high)  (((x) > (high)) ? 1 : (((x) < (low)) ? 1 : 0))
 
-gint8 *process8 (void* buf, gint n_samples, gint nch, gfloat gain);
-guint8 *process8u (void* buf, gint n_samples, gint nch, gfloat gain);
-gint16 *process16 (void* buf, gint n_samples, gint nch, gfloat gain);
-guint16 *process16u (void* buf, gint n_samples, gint nch, gfloat gain);
-gint32 *process32 (void* buf, gint n_samples, gint nch, gfloat gain);
-guint32 *process32u (void* buf, gint n_samples, gint nch, gfloat gain);
-gint64 *process64 (void* buf, gint n_samples, gint nch, gfloat gain);
-guint64 *process64u (void* buf, gint n_samples, gint nch, gfloat gain);
-gfloat *processf (void* buf, gint n_samples, gint nch, gfloat gain);
-gdouble *processd (void* buf, gint n_samples, gint nch, gfloat gain);
+/* Level, as a fraction of full scale, above which DELTA_CLIP_SOFT starts
+ * to bend the output.  Samples below it are passed exactly as with
+ * DELTA_CLIP_HARD; above it a quadratic curve takes the output smoothly to
+ * full scale, which is reached at (2 - DELTA_SOFT_CLIP_KNEE) times full
+ * scale.  Louder samples are then clipped as before. */
+#define DELTA_SOFT_CLIP_KNEE 0.5
+
+typedef enum {
+  DELTA_CLIP_HARD,
+  DELTA_CLIP_SOFT
+} DeltaClipMode;
+
+/* Gains of the individual channels.  Channels with a gain of zero are
+ * not in the active list and the kernels leave them untouched. */
+typedef struct {
+  gint channels;
+  gfloat *gains;                /* [channel] */
+  gint n_active;
+  gint *active;                 /* channels with a non-zero gain */
+  gboolean uniform;             /* all channels active with the same gain */
+  gint n_lanes;                 /* a whole number of frames */
+  gfloat *lanes;                /* [n_lanes], gains repeated frame by frame,
+                                 * last sample first */
+} DeltaChannelGains;
+
+void delta_channel_gains_init (DeltaChannelGains *cg);
+void delta_channel_gains_clear (DeltaChannelGains *cg);
+gboolean delta_channel_gains_set (DeltaChannelGains *cg, gint channels,
+    gfloat gain, const gfloat *gains, gint n_gains);
+
+/* The sample kernels.  They process buf in place and return it;
+ * channel_gains, when not NULL, replaces gain. */
+typedef gpointer (*DeltaProcessFunc) (void* buf, gint n_samples, gint nch,
+    gfloat gain, const DeltaChannelGains *channel_gains,
+    DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
+
+gpointer process8 (void* buf, gint n_samples, gint nch, gfloat gain, const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
+gpointer process8u (void* buf, gint n_samples, gint nch, gfloat gain, const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
+gpointer process16 (void* buf, gint n_samples, gint nch, gfloat gain, const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
+gpointer process16u (void* buf, gint n_samples, gint nch, gfloat gain, const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
+gpointer process32 (void* buf, gint n_samples, gint nch, gfloat gain, const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
+gpointer process32u (void* buf, gint n_samples, gint nch, gfloat gain, const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
+gpointer process64 (void* buf, gint n_samples, gint nch, gfloat gain, const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
+gpointer process64u (void* buf, gint n_samples, gint nch, gfloat gain, const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
+gpointer processf (void* buf, gint n_samples, gint nch, gfloat gain, const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
+gpointer processd (void* buf, gint n_samples, gint nch, gfloat gain, const DeltaChannelGains *channel_gains, DeltaClipMode clip_mode, DeltaEmphasis *emphasis, DeltaDither *dither);
 
+#endif /* __DELTA_H__ */
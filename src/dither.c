@@ -0,0 +1,64 @@
+/*
+    Noise Sharpening dsp
+    Copyright (C) 2010 Robert Y <Decatf@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <string.h>
+#include <gst/gst.h>
+#include "dither.h"
+
+void delta_dither_init (DeltaDither *dither)
+{
+  memset (dither, 0, sizeof (DeltaDither));
+}
+
+void delta_dither_clear (DeltaDither *dither)
+{
+  g_free (dither->rng);
+  g_free (dither->error);
+  g_free (dither->history);
+  dither->rng = NULL;
+  dither->error = dither->history = NULL;
+  dither->channels = 0;
+}
+
+void delta_dither_set_channels (DeltaDither *dither, gint channels)
+{
+  if (dither->channels != channels) {
+    delta_dither_clear (dither);
+    dither->channels = channels;
+    dither->rng = g_new (guint32, channels);
+    dither->error = g_new0 (gdouble, channels);
+    dither->history = g_new0 (gdouble, channels);
+  }
+  delta_dither_reset (dither);
+}
+
+/* Start every generator over from a seed of its own and the position from
+ * the beginning, so the output does not depend on what was played before,
+ * and forget the shaping error. */
+void delta_dither_reset (DeltaDither *dither)
+{
+  dither->position = 0;
+  for (gint j = 0; j < dither->channels; j++) {
+    /* a different seed for every channel; xorshift must not start at 0 */
+    dither->rng[j] = 0x2545f491u ^ ((guint32) (j + 1) * 0x9e3779b9u);
+    if (dither->rng[j] == 0)
+      dither->rng[j] = 0x2545f491u;
+    dither->error[j] = 0.0;
+  }
+}
@@ -0,0 +1,59 @@
+/*
+    Noise Sharpening dsp
+    Copyright (C) 2010 Robert Y <Decatf@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef __DITHER_H__
+#define __DITHER_H__
+
+/*
+ * Dither for the integer kernels.  Instead of truncating the gdouble
+ * result, the kernels add triangular (TPDF) noise of +-1 LSB and round.
+ * With noise shaping the previous quantisation error of the channel is
+ * subtracted first, which moves the noise towards the top of the
+ * spectrum where it is hardest to hear.
+ *
+ * Every channel has a xorshift32 generator of its own, so the channels
+ * of a frame can be dithered side by side.  Without shaping and emphasis
+ * the kernels dither in their backward loop instead, with noise hashed
+ * from the position of each sample in the stream, which does not depend
+ * on the order the samples are visited in.  Float kernels ignore dither.
+ */
+
+typedef enum {
+  DELTA_DITHER_NONE,
+  DELTA_DITHER_TPDF,
+  DELTA_DITHER_TPDF_SHAPED
+} DeltaDitherMode;
+
+typedef struct {
+  DeltaDitherMode mode;
+
+  gint channels;
+  guint32 *rng;                 /* [channel] xorshift32 state, never 0 */
+  guint32 position;             /* samples since the last reset */
+  gdouble *error;               /* [channel] last quantisation error */
+  gdouble *history;             /* [channel] previous input sample, when
+                                 * no emphasis carries it */
+} DeltaDither;
+
+void delta_dither_init (DeltaDither *dither);
+void delta_dither_clear (DeltaDither *dither);
+void delta_dither_set_channels (DeltaDither *dither, gint channels);
+void delta_dither_reset (DeltaDither *dither);
+
+#endif /* __DITHER_H__ */
@@ -0,0 +1,124 @@
+/*
+    Noise Sharpening dsp
+    Copyright (C) 2010 Robert Y <Decatf@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <gst/gst.h>
+#include "emphasis.h"
+
+/* Q of the two sections of a 4th order Butterworth low-pass */
+static const gdouble butterworth4_q[] = { 0.54119610014619698, 1.3065629648763766 };
+
+void delta_emphasis_init (DeltaEmphasis *emphasis)
+{
+  memset (emphasis, 0, sizeof (DeltaEmphasis));
+}
+
+void delta_emphasis_clear (DeltaEmphasis *emphasis)
+{
+  g_free (emphasis->history);
+  g_free (emphasis->z1);
+  g_free (emphasis->z2);
+  g_free (emphasis->diff);
+  emphasis->history = emphasis->z1 = emphasis->z2 = emphasis->diff = NULL;
+  emphasis->channels = 0;
+  emphasis->primed = FALSE;
+}
+
+void delta_emphasis_set_channels (DeltaEmphasis *emphasis, gint channels)
+{
+  if (emphasis->channels != channels) {
+    delta_emphasis_clear (emphasis);
+    emphasis->channels = channels;
+    emphasis->history = g_new0 (gdouble, channels);
+    emphasis->z1 = g_new0 (gdouble, DELTA_EMPHASIS_MAX_STAGES * channels);
+    emphasis->z2 = g_new0 (gdouble, DELTA_EMPHASIS_MAX_STAGES * channels);
+    emphasis->diff = g_new0 (gdouble, channels);
+  }
+  delta_emphasis_reset (emphasis);
+}
+
+/* Forget the signal seen so far, e.g. after a discontinuity.  The next
+ * buffer starts the history over from its first frame. */
+void delta_emphasis_reset (DeltaEmphasis *emphasis)
+{
+  gint n = DELTA_EMPHASIS_MAX_STAGES * emphasis->channels;
+
+  emphasis->primed = FALSE;
+  if (n > 0) {
+    memset (emphasis->z1, 0, n * sizeof (gdouble));
+    memset (emphasis->z2, 0, n * sizeof (gdouble));
+  }
+}
+
+static void
+biquad_normalize (DeltaBiquad *bq, gdouble b0, gdouble b1, gdouble b2,
+    gdouble a0, gdouble a1, gdouble a2)
+{
+  bq->b0 = b0 / a0;
+  bq->b1 = b1 / a0;
+  bq->b2 = b2 / a0;
+  bq->a1 = a1 / a0;
+  bq->a2 = a2 / a0;
+}
+
+/* The designs follow the Audio EQ Cookbook by Robert Bristow-Johnson.
+ * Changing the design keeps the filter state, so property changes while
+ * playing do not click. */
+void delta_emphasis_design (DeltaEmphasis *emphasis, DeltaEmphasisType type,
+    gdouble rate, gdouble frequency, gdouble gain_db)
+{
+  gdouble w0, cosw0, sinw0;
+
+  if (type == DELTA_EMPHASIS_NONE || rate <= 0) {
+    emphasis->n_stages = 0;
+    return;
+  }
+
+  /* keep the corner clear of DC and nyquist */
+  frequency = CLAMP (frequency, 10.0, 0.45 * rate);
+  w0 = 2.0 * G_PI * frequency / rate;
+  cosw0 = cos (w0);
+  sinw0 = sin (w0);
+
+  if (type == DELTA_EMPHASIS_LOW_PASS) {
+    for (int i = 0; i < 2; i++) {
+      gdouble alpha = sinw0 / (2.0 * butterworth4_q[i]);
+
+      biquad_normalize (&emphasis->stages[i],
+          (1.0 - cosw0) / 2.0, 1.0 - cosw0, (1.0 - cosw0) / 2.0,
+          1.0 + alpha, -2.0 * cosw0, 1.0 - alpha);
+    }
+    emphasis->n_stages = 2;
+  } else {
+    /* shelf slope S = 1 */
+    gdouble A = pow (10.0, gain_db / 40.0);
+    gdouble alpha = sinw0 / 2.0 * G_SQRT2;
+    gdouble k = 2.0 * sqrt (A) * alpha;
+
+    biquad_normalize (&emphasis->stages[0],
+        A * ((A + 1.0) + (A - 1.0) * cosw0 + k),
+        -2.0 * A * ((A - 1.0) + (A + 1.0) * cosw0),
+        A * ((A + 1.0) + (A - 1.0) * cosw0 - k),
+        (A + 1.0) - (A - 1.0) * cosw0 + k,
+        2.0 * ((A - 1.0) - (A + 1.0) * cosw0),
+        (A + 1.0) - (A - 1.0) * cosw0 - k);
+    emphasis->n_stages = 1;
+  }
+}
@@ -0,0 +1,72 @@
+/*
+    Noise Sharpening dsp
+    Copyright (C) 2010 Robert Y <Decatf@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef __EMPHASIS_H__
+#define __EMPHASIS_H__
+
+/*
+ * Emphasis shapes the difference term of the delta filter before it is
+ * added back to the sample, so the sharpening can be kept away from the
+ * hiss at the top of the spectrum:
+ *
+ *   y[n] = x[n] + gain * H(x[n] - x[n-1])
+ *
+ * H is a cascade of up to DELTA_EMPHASIS_MAX_STAGES biquads.  Filter
+ * state is kept per channel and carries over from one buffer to the next.
+ * With continuous set the history of the input carries over as well when
+ * there is no filter, so that only the very first frame is left
+ * unprocessed instead of the first frame of every buffer.
+ */
+
+#define DELTA_EMPHASIS_MAX_STAGES 2
+
+typedef enum {
+  DELTA_EMPHASIS_NONE,
+  DELTA_EMPHASIS_LOW_PASS,
+  DELTA_EMPHASIS_HIGH_SHELF
+} DeltaEmphasisType;
+
+/* coefficients normalized to a0 = 1, run as transposed direct form II */
+typedef struct {
+  gdouble b0, b1, b2;
+  gdouble a1, a2;
+} DeltaBiquad;
+
+typedef struct {
+  gint n_stages;                /* 0 when emphasis is off */
+  DeltaBiquad stages[DELTA_EMPHASIS_MAX_STAGES];
+
+  gboolean continuous;           /* carry history without a filter too */
+
+  gint channels;
+  gboolean primed;              /* history holds the last frame */
+  gdouble *history;             /* [channel] previous input sample */
+  gdouble *z1;                  /* [stage * channels + channel] */
+  gdouble *z2;                  /* [stage * channels + channel] */
+  gdouble *diff;                /* [channel] scratch for the kernels */
+} DeltaEmphasis;
+
+void delta_emphasis_init (DeltaEmphasis *emphasis);
+void delta_emphasis_clear (DeltaEmphasis *emphasis);
+void delta_emphasis_set_channels (DeltaEmphasis *emphasis, gint channels);
+void delta_emphasis_reset (DeltaEmphasis *emphasis);
+void delta_emphasis_design (DeltaEmphasis *emphasis, DeltaEmphasisType type,
+    gdouble rate, gdouble frequency, gdouble gain_db);
+
+#endif /* __EMPHASIS_H__ */
@@ -53,6 +53,22 @@
  * |[
  * gst-launch -v -m audiotestsrc ! delta_dsp gain=120 ! autoaudiosink
  * ]|
+ * |[
+ * gst-launch -v -m audiotestsrc ! delta gain=180 clip-mode=soft ! autoaudiosink
+ * ]| Soft clipping keeps high gains from clipping audibly.
+ * |[
+ * gst-launch -v -m audiotestsrc ! delta gain=150 emphasis=low-pass emphasis-frequency=5000 ! autoaudiosink
+ * ]| Emphasis filters the sharpening, here keeping it off the hiss above 5 kHz.
+ * |[
+ * gst-launch -v -m audiotestsrc ! audio/x-raw,channels=6 ! delta channel-gains="<150,150,0,0,120,120>" ! autoaudiosink
+ * ]| Sharpen a 5.1 stream, leaving the centre and LFE channels untouched.
+ * |[
+ * gst-launch -v -m autoaudiosrc blocksize=128 ! delta low-latency=true ! autoaudiosink
+ * ]| Process small buffers in place, carrying the history from one buffer to
+ * the next.
+ * |[
+ * gst-launch -v -m audiotestsrc ! audio/x-raw,format=S16LE ! delta gain=150 dither=tpdf-shaped ! autoaudiosink
+ * ]| Dither the rounding of 16 bit output and push its noise up the spectrum.
  * </refsect2>
  */
  
@@ -75,9 +91,80 @@ enum
 {
   ARG_0,
   PROP_GAIN,
+  PROP_CHANNEL_GAINS,
+  PROP_CLIP_MODE,
+  PROP_EMPHASIS,
+  PROP_EMPHASIS_FREQUENCY,
+  PROP_EMPHASIS_GAIN,
+  PROP_LOW_LATENCY,
+  PROP_DITHER,
   PROP_SILENT
 };
 
+#define DEFAULT_EMPHASIS_FREQUENCY 6000.0
+#define DEFAULT_EMPHASIS_GAIN -12.0
+
+#define GST_TYPE_DELTA_DSP_CLIP_MODE (gst_delta_dsp_clip_mode_get_type ())
+static GType
+gst_delta_dsp_clip_mode_get_type (void)
+{
+  static GType clip_mode_type = 0;
+  static const GEnumValue clip_modes[] = {
+    {DELTA_CLIP_HARD, "Clip at full scale", "hard"},
+    {DELTA_CLIP_SOFT, "Saturate smoothly towards full scale", "soft"},
+    {0, NULL, NULL}
+  };
+
+  if (!clip_mode_type) {
+    clip_mode_type =
+        g_enum_register_static ("GstDeltaDspClipMode", clip_modes);
+  }
+  return clip_mode_type;
+}
+
+#define GST_TYPE_DELTA_DSP_EMPHASIS (gst_delta_dsp_emphasis_get_type ())
+static GType
+gst_delta_dsp_emphasis_get_type (void)
+{
+  static GType emphasis_type = 0;
+  static const GEnumValue emphases[] = {
+    {DELTA_EMPHASIS_NONE, "Sharpen all frequencies alike", "none"},
+    {DELTA_EMPHASIS_LOW_PASS,
+        "Only sharpen below emphasis-frequency", "low-pass"},
+    {DELTA_EMPHASIS_HIGH_SHELF,
+        "Scale the sharpening above emphasis-frequency by emphasis-gain",
+        "high-shelf"},
+    {0, NULL, NULL}
+  };
+
+  if (!emphasis_type) {
+    emphasis_type =
+        g_enum_register_static ("GstDeltaDspEmphasis", emphases);
+  }
+  return emphasis_type;
+}
+
+#define GST_TYPE_DELTA_DSP_DITHER (gst_delta_dsp_dither_get_type ())
+static GType
+gst_delta_dsp_dither_get_type (void)
+{
+  static GType dither_type = 0;
+  static const GEnumValue dithers[] = {
+    {DELTA_DITHER_NONE, "Truncate to the sample format", "none"},
+    {DELTA_DITHER_TPDF, "Round with triangular dither", "tpdf"},
+    {DELTA_DITHER_TPDF_SHAPED,
+        "Round with triangular dither and first order noise shaping",
+        "tpdf-shaped"},
+    {0, NULL, NULL}
+  };
+
+  if (!dither_type) {
+    dither_type =
+        g_enum_register_static ("GstDeltaDspDither", dithers);
+  }
+  return dither_type;
+}
+
 /* debug category for fltering log messages */
 #define DEBUG_INIT(bla) \
   GST_DEBUG_CATEGORY_INIT (gst_delta_dsp_debug, "delta_dsp", 0, "Delta Dsp");
@@ -86,6 +173,7 @@ enum
 
 G_DEFINE_TYPE (GstDeltaDsp, gst_delta_dsp, GST_TYPE_AUDIO_FILTER);
 
+static void gst_delta_dsp_finalize (GObject * object);
 static void gst_delta_dsp_set_property (GObject * object,
     guint prop_id, const GValue * value, GParamSpec * pspec);
 static void gst_delta_dsp_get_property (GObject * object,
@@ -102,6 +190,8 @@ static gboolean
 		set_delta_filter_function (GstDeltaDsp *filter);
 static void 
 		delta_dsp_tostring(GstDeltaDsp *filter);
+static const DeltaChannelGains *
+		delta_dsp_update_state (GstDeltaDsp *filter, GstBuffer *buf);
 
 #if G_BYTE_ORDER == G_LITTLE_ENDIAN
 #define ALLOWED_CAPS \
@@ -128,11 +218,54 @@ gst_delta_dsp_class_init (GstDeltaDspClass * klass)
 
   gobject_class->set_property = gst_delta_dsp_set_property;
   gobject_class->get_property = gst_delta_dsp_get_property;
+  gobject_class->finalize = gst_delta_dsp_finalize;
 
   g_object_class_install_property (gobject_class, PROP_GAIN,
       g_param_spec_int ("gain", "Gain", "Delta gain to apply",
           0, 200, 100, G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_CHANNEL_GAINS,
+      gst_param_spec_array ("channel-gains", "Channel gains",
+          "Delta gain of each channel, in channel order; channels past the "
+          "end of the array use gain, and channels with a gain of 0 are "
+          "passed through untouched",
+          g_param_spec_int ("channel-gain", "Channel gain",
+              "Delta gain of one channel", 0, 200, 100, G_PARAM_READWRITE),
+          G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_CLIP_MODE,
+      g_param_spec_enum ("clip-mode", "Clip mode",
+          "How samples past full scale are limited",
+          GST_TYPE_DELTA_DSP_CLIP_MODE, DELTA_CLIP_HARD, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_EMPHASIS,
+      g_param_spec_enum ("emphasis", "Emphasis",
+          "Filter applied to the difference term before it is added back",
+          GST_TYPE_DELTA_DSP_EMPHASIS, DELTA_EMPHASIS_NONE,
+          G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_EMPHASIS_FREQUENCY,
+      g_param_spec_double ("emphasis-frequency", "Emphasis frequency",
+          "Corner frequency of the emphasis filter in Hz",
+          10.0, 96000.0, DEFAULT_EMPHASIS_FREQUENCY, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_EMPHASIS_GAIN,
+      g_param_spec_double ("emphasis-gain", "Emphasis gain",
+          "Gain of the high-shelf emphasis above its corner in dB",
+          -24.0, 24.0, DEFAULT_EMPHASIS_GAIN, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_LOW_LATENCY,
+      g_param_spec_boolean ("low-latency", "Low latency",
+          "Process buffers in place and carry the history over from one "
+          "buffer to the next, for small buffers",
+          FALSE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_DITHER,
+      g_param_spec_enum ("dither", "Dither",
+          "Dither applied when rounding to integer formats; float formats "
+          "are left alone",
+          GST_TYPE_DELTA_DSP_DITHER, DELTA_DITHER_NONE, G_PARAM_READWRITE));
+
   g_object_class_install_property (gobject_class, PROP_SILENT,
       g_param_spec_boolean ("silent", "Silent", "Produce verbose output ?",
           FALSE, G_PARAM_READWRITE));
@@ -169,7 +302,39 @@ gst_delta_dsp_init (GstDeltaDsp * filter)
   /* initialize default filter settings */
 	filter->negotiated = FALSE;
 	filter->gain = 1.00f;
+	filter->clip_mode = DELTA_CLIP_HARD;
 	filter->silent = TRUE;
+	filter->low_latency = FALSE;
+
+	filter->emphasis_type = DELTA_EMPHASIS_NONE;
+	filter->emphasis_frequency = DEFAULT_EMPHASIS_FREQUENCY;
+	filter->emphasis_gain = DEFAULT_EMPHASIS_GAIN;
+	filter->emphasis_dirty = TRUE;
+	delta_emphasis_init (&filter->emphasis);
+
+	filter->dither_mode = DELTA_DITHER_NONE;
+	delta_dither_init (&filter->dither);
+
+	filter->channel_gain_values = NULL;
+	filter->n_channel_gains = 0;
+	filter->gains_dirty = TRUE;
+	delta_channel_gains_init (&filter->channel_gains);
+	filter->per_channel = FALSE;
+
+	filter->settings_changed = TRUE;
+}
+
+static void
+gst_delta_dsp_finalize (GObject * object)
+{
+  GstDeltaDsp *filter = GST_DELTA_DSP (object);
+
+  delta_emphasis_clear (&filter->emphasis);
+  delta_dither_clear (&filter->dither);
+  delta_channel_gains_clear (&filter->channel_gains);
+  g_free (filter->channel_gain_values);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
 static void
@@ -177,11 +342,48 @@ gst_delta_dsp_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
 {
   GstDeltaDsp *filter = GST_DELTA_DSP (object);
+  gboolean low_latency;
 
   GST_OBJECT_LOCK (filter);	
   switch (prop_id) {
     case PROP_GAIN:
       filter->gain = (gfloat)(g_value_get_int (value)/100.f);
+      filter->gains_dirty = TRUE;
+      break;
+    case PROP_CHANNEL_GAINS:
+    {
+      gint n = gst_value_array_get_size (value);
+
+      g_free (filter->channel_gain_values);
+      filter->channel_gain_values = g_new (gfloat, MAX (n, 1));
+      for (gint i = 0; i < n; i++)
+        filter->channel_gain_values[i] = (gfloat)(g_value_get_int (
+            gst_value_array_get_value (value, i))/100.f);
+      filter->n_channel_gains = n;
+      filter->gains_dirty = TRUE;
+      break;
+    }
+    case PROP_CLIP_MODE:
+      filter->clip_mode = g_value_get_enum (value);
+      break;
+    case PROP_EMPHASIS:
+      filter->emphasis_type = g_value_get_enum (value);
+      filter->emphasis_dirty = TRUE;
+      break;
+    case PROP_EMPHASIS_FREQUENCY:
+      filter->emphasis_frequency = g_value_get_double (value);
+      filter->emphasis_dirty = TRUE;
+      break;
+    case PROP_EMPHASIS_GAIN:
+      filter->emphasis_gain = g_value_get_double (value);
+      filter->emphasis_dirty = TRUE;
+      break;
+    case PROP_LOW_LATENCY:
+      filter->low_latency = g_value_get_boolean (value);
+      filter->emphasis_dirty = TRUE;
+      break;
+    case PROP_DITHER:
+      filter->dither_mode = g_value_get_enum (value);
       break;
     case PROP_SILENT:
       filter->silent = g_value_get_boolean (value);
@@ -190,7 +392,13 @@ gst_delta_dsp_set_property (GObject * object, guint prop_id,
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
+  low_latency = filter->low_latency;
+  g_atomic_int_set (&filter->settings_changed, TRUE);
   GST_OBJECT_UNLOCK (filter);
+
+  /* takes the object lock itself */
+  if (prop_id == PROP_LOW_LATENCY)
+    gst_base_transform_set_in_place (GST_BASE_TRANSFORM (filter), low_latency);
 }
 
 static void
@@ -204,6 +412,36 @@ gst_delta_dsp_get_property (GObject * object, guint prop_id,
     case PROP_GAIN:
       g_value_set_int (value, (gint)(filter->gain*100));
       break;
+    case PROP_CHANNEL_GAINS:
+    {
+      GValue v = G_VALUE_INIT;
+
+      g_value_init (&v, G_TYPE_INT);
+      for (gint i = 0; i < filter->n_channel_gains; i++) {
+        g_value_set_int (&v, (gint)(filter->channel_gain_values[i]*100 + 0.5f));
+        gst_value_array_append_value (value, &v);
+      }
+      g_value_unset (&v);
+      break;
+    }
+    case PROP_CLIP_MODE:
+      g_value_set_enum (value, filter->clip_mode);
+      break;
+    case PROP_EMPHASIS:
+      g_value_set_enum (value, filter->emphasis_type);
+      break;
+    case PROP_EMPHASIS_FREQUENCY:
+      g_value_set_double (value, filter->emphasis_frequency);
+      break;
+    case PROP_EMPHASIS_GAIN:
+      g_value_set_double (value, filter->emphasis_gain);
+      break;
+    case PROP_LOW_LATENCY:
+      g_value_set_boolean (value, filter->low_latency);
+      break;
+    case PROP_DITHER:
+      g_value_set_enum (value, filter->dither_mode);
+      break;
     case PROP_SILENT:
       g_value_set_boolean (value, (gboolean)filter->silent);
       break;
@@ -229,6 +467,12 @@ gst_delta_dsp_setup (GstAudioFilter * filter,
 	if (res == TRUE) {
 		GST_OBJECT_LOCK(delta_dsp);
   	res = set_delta_filter_function(delta_dsp);
+		/* new format, so the filter state no longer applies */
+		delta_emphasis_set_channels (&delta_dsp->emphasis, delta_dsp->channels);
+		delta_dither_set_channels (&delta_dsp->dither, delta_dsp->channels);
+		delta_dsp->emphasis_dirty = TRUE;
+		delta_dsp->gains_dirty = TRUE;
+		g_atomic_int_set (&delta_dsp->settings_changed, TRUE);
 		GST_OBJECT_UNLOCK(delta_dsp);
 	}
 	else {
@@ -256,6 +500,7 @@ setup_delta_dsp_caps(GstAudioInfo * info, GstDeltaDsp* delta_dsp)
 	{
 		delta_dsp->sign = finfo->flags & GST_AUDIO_FORMAT_FLAG_SIGNED;
 		delta_dsp->channels = info->channels;
+		delta_dsp->rate = info->rate;
 
     delta_dsp->width = finfo->width;
 		delta_dsp->datatype_nbytes = delta_dsp->width / 8;
@@ -298,6 +543,7 @@ gst_delta_dsp_filter (GstBaseTransform * base_transform,
 
   /* copy the source buffer to destination buffer */
 	GstMapInfo src_map_info, dest_map_info;
+	const DeltaChannelGains *channel_gains;
 	gboolean res;
 	res = gst_buffer_map(inbuf, &src_map_info, GST_MAP_READ);
 	if (res == FALSE) {
@@ -313,12 +559,18 @@ gst_delta_dsp_filter (GstBaseTransform * base_transform,
 	memcpy (dest_map_info.data, src_map_info.data,
 		src_map_info.size);
 
+	channel_gains = delta_dsp_update_state (delta_dsp, inbuf);
+
   /* Apply the filter function */
 	if (delta_dsp->process != NULL)
 		delta_dsp->process (dest_map_info.data, 
 				dest_map_info.size / delta_dsp->datatype_nbytes, 
 				delta_dsp->channels, 
-				delta_dsp->gain);
+				delta_dsp->gain,
+				channel_gains,
+				delta_dsp->clip_mode,
+				&delta_dsp->emphasis,
+				&delta_dsp->dither);
 
 	gst_buffer_unmap(inbuf, &src_map_info);
 	gst_buffer_unmap(outbuf, &dest_map_info);
@@ -333,25 +585,33 @@ gst_delta_dsp_filter_inplace (GstBaseTransform * base_transform,
   GstDeltaDsp *delta_dsp;
   delta_dsp = GST_DELTA_DSP (base_transform);
 
-  if (G_UNLIKELY (!delta_dsp->negotiated)) {
-		GST_ELEMENT_ERROR (delta_dsp, CORE, NEGOTIATION,
-				("No format was negotiated"), (NULL));
-		return GST_FLOW_NOT_NEGOTIATED;
-  }
-
-  /* Apply the filter function */
+  /* Only low-latency runs in place.  There is no negotiated check here:
+   * GstBaseTransform refuses buffers until set_caps has succeeded, and
+   * a format without a kernel leaves process NULL, which is checked below
+   * anyway.  The buffer is mapped with gst_buffer_map rather than
+   * GstAudioBuffer, which needs GStreamer 1.16 where this plugin supports
+   * 1.14, and which for interleaved samples maps the same single range
+   * after looking up the GstAudioMeta.  The kernels read and write the
+   * samples in place, so the map is READ | WRITE. */
 	GstMapInfo map_info;
+	const DeltaChannelGains *channel_gains;
 	gboolean res = gst_buffer_map(buf, &map_info,  GST_MAP_READ | GST_MAP_WRITE);
 	if (res == FALSE) {
 		GST_ERROR ("buffer map failed.\n");
 		return GST_FLOW_ERROR;
 	}
 
+	channel_gains = delta_dsp_update_state (delta_dsp, buf);
+
 	if (delta_dsp->process != NULL)
 		delta_dsp->process (map_info.data, 
 				map_info.size / delta_dsp->datatype_nbytes, 
 				delta_dsp->channels, 
-				delta_dsp->gain);
+				delta_dsp->gain,
+				channel_gains,
+				delta_dsp->clip_mode,
+				&delta_dsp->emphasis,
+				&delta_dsp->dither);
 
 	gst_buffer_unmap(buf, &map_info);
 
@@ -366,35 +626,88 @@ static gboolean set_delta_filter_function (GstDeltaDsp *filter) {
   if (filter->is_int) {
     if (filter->width == 8) {
       if (filter->sign)
-        filter->process = (void*)process8;
+        filter->process = process8;
       else
-        filter->process = (void*)process8u;
+        filter->process = process8u;
     } else if (filter->width == 16) {
       if (filter->sign)
-        filter->process = (void*)process16;
+        filter->process = process16;
       else
-        filter->process = (void*)process16u;
+        filter->process = process16u;
     } else if (filter->width == 32) {
       if (filter->sign)
-        filter->process = (void*)process32;
+        filter->process = process32;
       else
-        filter->process = (void*)process32u;
+        filter->process = process32u;
     } else if (filter->width == 64) {
       if (filter->sign)
-        filter->process = (void*)process64;
+        filter->process = process64;
       else
-        filter->process = (void*)process64u;
+        filter->process = process64u;
     }
   } else {
 		if (filter->width == 32)
-	    filter->process = (void*)processf;
+	    filter->process = processf;
 		else if (filter->width == 64)
-	    filter->process = (void*)processd;
+	    filter->process = processd;
   }
 
 	return filter->process != NULL;
 }
 
+/*
+ * Called from the streaming thread before each buffer.  Property changes
+ * only mark the gains and emphasis dirty, so they never change while a
+ * kernel is running.  The filter state is kept across redesigns and
+ * buffers, and only dropped on a discontinuity or when it was not kept up
+ * to date: when the set of channels being processed changes, as skipped
+ * channels do not keep their history, and when the filter or low-latency
+ * comes back on, as the plain loop that ran while both were off does not
+ * keep any.
+ */
+static const DeltaChannelGains *
+delta_dsp_update_state (GstDeltaDsp *filter, GstBuffer *buf)
+{
+	gboolean reset = GST_BUFFER_IS_DISCONT (buf);
+
+	if (G_UNLIKELY (g_atomic_int_get (&filter->settings_changed))) {
+		GST_OBJECT_LOCK (filter);
+		g_atomic_int_set (&filter->settings_changed, FALSE);
+		if (filter->gains_dirty) {
+			gboolean changed = delta_channel_gains_set (&filter->channel_gains,
+					filter->channels, filter->gain, filter->channel_gain_values,
+					filter->n_channel_gains);
+			/* clearing channel-gains runs every channel again, and the ones
+			 * that were skipped have no history */
+			reset |= changed && (filter->per_channel ||
+					filter->n_channel_gains > 0);
+			filter->gains_dirty = FALSE;
+		}
+		if (filter->emphasis_dirty) {
+			gboolean was_running = filter->emphasis.n_stages > 0 ||
+					filter->emphasis.continuous;
+
+			delta_emphasis_design (&filter->emphasis, filter->emphasis_type,
+					filter->rate, filter->emphasis_frequency, filter->emphasis_gain);
+			filter->emphasis.continuous = filter->low_latency;
+			reset |= !was_running && (filter->emphasis.n_stages > 0 ||
+					filter->emphasis.continuous);
+			filter->emphasis_dirty = FALSE;
+		}
+		filter->per_channel = filter->n_channel_gains > 0;
+		filter->dither.mode = filter->dither_mode;
+		GST_OBJECT_UNLOCK (filter);
+	}
+
+	if (reset) {
+		delta_emphasis_reset (&filter->emphasis);
+		delta_dither_reset (&filter->dither);
+	}
+
+	/* without channel-gains every channel runs with gain, as before */
+	return filter->per_channel ? &filter->channel_gains : NULL;
+}
+
 static void 
 delta_dsp_tostring(GstDeltaDsp *filter)
 {
@@ -406,9 +719,23 @@ delta_dsp_tostring(GstDeltaDsp *filter)
 	g_print("little_endian %s\n", filter->little_endian ? "LE" : "BE");
 	g_print("signed: %s\n", filter->sign ? "signed" : "unsigned");
 	g_print("width %d\n", filter->width);
+	g_print("rate %d\n", filter->rate);
 	g_print("datatype_nbytes %d\n", filter->datatype_nbytes);
 	g_print("--------\n");
 	g_print("gain %f\n", filter->gain);
+	for (gint i = 0; i < filter->n_channel_gains; i++)
+		g_print("channel %d gain %f\n", i, filter->channel_gain_values[i]);
+	g_print("clip_mode %s\n",
+			filter->clip_mode == DELTA_CLIP_SOFT ? "soft" : "hard");
+	g_print("emphasis %s %.1f Hz %.1f dB\n",
+			filter->emphasis_type == DELTA_EMPHASIS_LOW_PASS ? "low-pass" :
+			filter->emphasis_type == DELTA_EMPHASIS_HIGH_SHELF ? "high-shelf" :
+			"none", filter->emphasis_frequency, filter->emphasis_gain);
+	g_print("low_latency %d\n", filter->low_latency);
+	g_print("dither %s\n",
+			filter->dither_mode == DELTA_DITHER_TPDF ? "tpdf" :
+			filter->dither_mode == DELTA_DITHER_TPDF_SHAPED ? "tpdf-shaped" :
+			"none");
 	g_print("silent %d\n", filter->silent);
 	g_print("--------\n");
 }
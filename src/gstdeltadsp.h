@@ -48,6 +48,8 @@
 
 #include <gst/gst.h>
 
+#include "delta.h"
+
 G_BEGIN_DECLS
 
 typedef struct _GstDeltaDsp GstDeltaDsp;
@@ -73,16 +75,41 @@ struct _GstDeltaDsp
   gboolean little_endian;
   gboolean sign;
   gint width;
+  gint rate;
   //gint depth;
 
 	gint datatype_nbytes; // size of the data type (i.e. sizeof(float);)
 	gboolean negotiated;
 
   gfloat gain;
+  /* per channel gains as set on the property, resolved into
+   * channel_gains by the streaming thread when gains_dirty is set */
+  gfloat *channel_gain_values;
+  gint n_channel_gains;
+  gboolean gains_dirty;
+  DeltaChannelGains channel_gains;
+  DeltaClipMode clip_mode;
   gboolean silent;
+  gboolean low_latency;
+
+  /* set by anything that marks state dirty, so that the streaming thread
+   * only takes the object lock when there is something to pick up */
+  gint settings_changed;
+  gboolean per_channel;
+
+  /* emphasis settings; the filter is redesigned from them by the
+   * streaming thread when emphasis_dirty is set */
+  DeltaEmphasisType emphasis_type;
+  gdouble emphasis_frequency;
+  gdouble emphasis_gain;
+  gboolean emphasis_dirty;
+  DeltaEmphasis emphasis;
+
+  /* dither as set on the property, picked up by the streaming thread */
+  DeltaDitherMode dither_mode;
+  DeltaDither dither;
 
-  //void (*process)(void*, gint, gint, gfloat);
-	void (*process) ();
+	DeltaProcessFunc process;
 };
 
 struct _GstDeltaDspClass
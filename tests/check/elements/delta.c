@@ -0,0 +1,639 @@
+/* GStreamer
+ *
+ * unit test for delta
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+#include <gst/check/gstcheck.h>
+#include <gst/audio/audio.h>
+#include <gst/base/gstbasetransform.h>
+
+/* For ease of programming we use globals to keep refs for our floating
+ * src and sink pads we create; otherwise we always have to do get_pad,
+ * get_peer, and then remove references in every test function */
+static GstPad *mysrcpad, *mysinkpad;
+
+#define N_FRAMES 64
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw")
+    );
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("audio/x-raw")
+    );
+
+static GstElement *
+setup_delta (void)
+{
+  GstElement *delta;
+  GstSegment segment;
+
+  GST_DEBUG ("setup_delta");
+  delta = gst_check_setup_element ("delta");
+  mysrcpad = gst_check_setup_src_pad (delta, &srctemplate);
+  mysinkpad = gst_check_setup_sink_pad (delta, &sinktemplate);
+  gst_pad_set_active (mysrcpad, TRUE);
+  gst_pad_set_active (mysinkpad, TRUE);
+
+  fail_unless (gst_element_set_state (delta,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_SUCCESS,
+      "could not set to playing");
+
+  fail_unless (gst_pad_push_event (mysrcpad,
+          gst_event_new_stream_start ("test")));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_segment (&segment)));
+
+  return delta;
+}
+
+static void
+cleanup_delta (GstElement * delta)
+{
+  GST_DEBUG ("cleanup_delta");
+
+  gst_check_drop_buffers ();
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_check_teardown_src_pad (delta);
+  gst_check_teardown_sink_pad (delta);
+  gst_check_teardown_element (delta);
+}
+
+static void
+set_caps (const gchar * format, gint channels)
+{
+  GstCaps *caps;
+
+  caps = gst_caps_new_simple ("audio/x-raw",
+      "format", G_TYPE_STRING, format,
+      "rate", G_TYPE_INT, 44100,
+      "channels", G_TYPE_INT, channels,
+      "layout", G_TYPE_STRING, "interleaved", NULL);
+  if (channels > 2)
+    gst_caps_set_simple (caps, "channel-mask", GST_TYPE_BITMASK,
+        G_GUINT64_CONSTANT (0), NULL);
+  fail_unless (gst_pad_push_event (mysrcpad, gst_event_new_caps (caps)));
+  gst_caps_unref (caps);
+}
+
+static void
+fill_s16 (gint16 * samples, gint n_samples)
+{
+  gint i;
+
+  /* a square wave with a few full-scale steps so that the output clips,
+   * and uneven steps in between so that gains that are not exact in
+   * gfloat do not always land on the same integer */
+  for (i = 0; i < n_samples; i++)
+    samples[i] = (i / 4) % 2 ? -20000 + i * i % 1000 : 20000 - i * i % 1000;
+  samples[n_samples - 1] = G_MININT16;
+}
+
+static void
+fill_f32 (gfloat * samples, gint n_samples)
+{
+  gint i;
+
+  /* dyadic values keep the expected output exact */
+  for (i = 0; i < n_samples; i++)
+    samples[i] = (i / 3) % 2 ? -0.5f + (i % 16) / 64.f : 0.5f;
+}
+
+static void
+reference_s16 (gint16 * samples, gint n_samples, gint nch, gfloat gain)
+{
+  gint i;
+
+  for (i = n_samples - 1; i >= nch; i--) {
+    gdouble curr = samples[i];
+    gdouble result = curr + (gain * (curr - samples[i - nch]));
+
+    samples[i] = (gint16) CLAMP (result, G_MININT16, G_MAXINT16);
+  }
+}
+
+static void
+reference_f32 (gfloat * samples, gint n_samples, gint nch, gfloat gain)
+{
+  gint i;
+
+  for (i = n_samples - 1; i >= nch; i--)
+    samples[i] = samples[i] + (gain * (samples[i] - samples[i - nch]));
+}
+
+static GstBuffer *
+new_buffer (gconstpointer data, gsize size)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, size, NULL);
+
+  gst_buffer_fill (buffer, 0, data, size);
+  return buffer;
+}
+
+static void
+check_output (gconstpointer expected, gsize size)
+{
+  GstBuffer *outbuffer;
+
+  fail_unless_equals_int (g_list_length (buffers), 1);
+  fail_if ((outbuffer = (GstBuffer *) buffers->data) == NULL);
+  fail_unless (gst_buffer_memcmp (outbuffer, 0, expected, size) == 0);
+  fail_unless_equals_int (gst_buffer_get_size (outbuffer), size);
+
+  gst_check_drop_buffers ();
+}
+
+static void
+check_s16 (GstElement * delta, gint channels, gint gain, gboolean in_place)
+{
+  gint16 in[N_FRAMES * 8], expected[N_FRAMES * 8];
+  gint n_samples = N_FRAMES * channels;
+  gsize size = n_samples * sizeof (gint16);
+  GstBuffer *inbuffer;
+
+  fill_s16 (in, n_samples);
+  memcpy (expected, in, size);
+  reference_s16 (expected, n_samples, channels, gain / 100.f);
+
+  g_object_set (delta, "gain", gain, NULL);
+  gst_base_transform_set_in_place (GST_BASE_TRANSFORM (delta), in_place);
+
+  inbuffer = new_buffer (in, size);
+  if (in_place) {
+    /* a writable buffer is processed and pushed on as is */
+    fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+    fail_unless (buffers && buffers->data == inbuffer);
+  } else {
+    gst_buffer_ref (inbuffer);
+    fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+    fail_unless (buffers && buffers->data != inbuffer);
+    /* and the input is left alone */
+    fail_unless (gst_buffer_memcmp (inbuffer, 0, in, size) == 0);
+    gst_buffer_unref (inbuffer);
+  }
+
+  check_output (expected, size);
+}
+
+static void
+check_f32 (GstElement * delta, gint channels, gint gain, gboolean in_place)
+{
+  gfloat in[N_FRAMES * 8], expected[N_FRAMES * 8];
+  gint n_samples = N_FRAMES * channels;
+  gsize size = n_samples * sizeof (gfloat);
+
+  fill_f32 (in, n_samples);
+  memcpy (expected, in, size);
+  reference_f32 (expected, n_samples, channels, gain / 100.f);
+
+  g_object_set (delta, "gain", gain, NULL);
+  gst_base_transform_set_in_place (GST_BASE_TRANSFORM (delta), in_place);
+
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (in,
+              size)) == GST_FLOW_OK);
+
+  check_output (expected, size);
+}
+
+GST_START_TEST (test_in_place)
+{
+  GstElement *delta = setup_delta ();
+
+  set_caps (GST_AUDIO_NE (S16), 2);
+  check_s16 (delta, 2, 100, TRUE);
+  check_s16 (delta, 2, 200, TRUE);
+  check_s16 (delta, 2, 120, TRUE);
+  check_s16 (delta, 2, 180, TRUE);
+  check_s16 (delta, 2, 0, TRUE);
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_copy)
+{
+  GstElement *delta = setup_delta ();
+
+  set_caps (GST_AUDIO_NE (S16), 2);
+  check_s16 (delta, 2, 100, FALSE);
+  check_s16 (delta, 2, 200, FALSE);
+  check_s16 (delta, 2, 120, FALSE);
+  check_s16 (delta, 2, 180, FALSE);
+  check_s16 (delta, 2, 0, FALSE);
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_in_place_not_writable)
+{
+  GstElement *delta = setup_delta ();
+  gint16 in[N_FRAMES * 2], expected[N_FRAMES * 2];
+  GstBuffer *inbuffer;
+
+  set_caps (GST_AUDIO_NE (S16), 2);
+  gst_base_transform_set_in_place (GST_BASE_TRANSFORM (delta), TRUE);
+
+  fill_s16 (in, G_N_ELEMENTS (in));
+  memcpy (expected, in, sizeof (in));
+  reference_s16 (expected, G_N_ELEMENTS (in), 2, 1.0f);
+
+  /* holding a ref makes basetransform copy before processing in place */
+  inbuffer = new_buffer (in, sizeof (in));
+  gst_buffer_ref (inbuffer);
+  fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  fail_unless (gst_buffer_memcmp (inbuffer, 0, in, sizeof (in)) == 0);
+  gst_buffer_unref (inbuffer);
+
+  check_output (expected, sizeof (in));
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_renegotiation)
+{
+  GstElement *delta = setup_delta ();
+
+  set_caps (GST_AUDIO_NE (S16), 2);
+  check_s16 (delta, 2, 150, TRUE);
+  check_s16 (delta, 2, 150, FALSE);
+
+  set_caps (GST_AUDIO_NE (F32), 1);
+  check_f32 (delta, 1, 150, TRUE);
+  check_f32 (delta, 1, 150, FALSE);
+
+  set_caps (GST_AUDIO_NE (S16), 8);
+  check_s16 (delta, 8, 150, TRUE);
+  check_s16 (delta, 8, 150, FALSE);
+
+  set_caps (GST_AUDIO_NE (F32), 2);
+  check_f32 (delta, 2, 150, TRUE);
+  check_f32 (delta, 2, 150, FALSE);
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_clip_mode)
+{
+  GstElement *delta = setup_delta ();
+  gint16 in[N_FRAMES * 2], hard[N_FRAMES * 2];
+  GstBuffer *outbuffer;
+  GstMapInfo map;
+  gboolean bent = FALSE;
+  gint clip_mode, i;
+
+  g_object_get (delta, "clip-mode", &clip_mode, NULL);
+  fail_unless_equals_int (clip_mode, 0);
+
+  set_caps (GST_AUDIO_NE (S16), 2);
+  fill_s16 (in, G_N_ELEMENTS (in));
+  memcpy (hard, in, sizeof (in));
+  reference_s16 (hard, G_N_ELEMENTS (in), 2, 2.0f);
+
+  gst_util_set_object_arg (G_OBJECT (delta), "clip-mode", "soft");
+  g_object_get (delta, "clip-mode", &clip_mode, NULL);
+  fail_unless_equals_int (clip_mode, 1);
+  g_object_set (delta, "gain", 200, NULL);
+
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (in,
+              sizeof (in))) == GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 1);
+  outbuffer = (GstBuffer *) buffers->data;
+  fail_unless (gst_buffer_map (outbuffer, &map, GST_MAP_READ));
+
+  /* quiet samples pass as they are, loud ones come out quieter than the
+   * hard clipped ones */
+  for (i = 0; i < G_N_ELEMENTS (in); i++) {
+    gint16 soft = ((gint16 *) map.data)[i];
+
+    if (ABS (hard[i]) <= G_MAXINT16 / 2)
+      fail_unless_equals_int (soft, hard[i]);
+    else
+      fail_unless (ABS (soft) <= ABS (hard[i]));
+    bent |= soft != hard[i];
+  }
+  fail_unless (bent);
+
+  gst_buffer_unmap (outbuffer, &map);
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+/* the low-pass emphasis keeps the sharpening off a signal at nyquist,
+ * which the plain filter would triple, and its state carries over from
+ * one buffer to the next */
+GST_START_TEST (test_emphasis)
+{
+  GstElement *delta = setup_delta ();
+  gfloat in[N_FRAMES];
+  gdouble frequency;
+  gint emphasis, i, b;
+
+  g_object_get (delta, "emphasis", &emphasis, NULL);
+  fail_unless_equals_int (emphasis, 0);
+
+  gst_util_set_object_arg (G_OBJECT (delta), "emphasis", "low-pass");
+  g_object_set (delta, "emphasis-frequency", 2000.0, "gain", 200, NULL);
+  g_object_get (delta, "emphasis", &emphasis, "emphasis-frequency",
+      &frequency, NULL);
+  fail_unless_equals_int (emphasis, 1);
+  fail_unless (frequency == 2000.0);
+
+  set_caps (GST_AUDIO_NE (F32), 1);
+  for (i = 0; i < N_FRAMES; i++)
+    in[i] = i % 2 ? -0.25f : 0.25f;
+
+  for (b = 0; b < 4; b++) {
+    fail_unless (gst_pad_push (mysrcpad, new_buffer (in,
+                sizeof (in))) == GST_FLOW_OK);
+  }
+  fail_unless_equals_int (g_list_length (buffers), 4);
+
+  /* by the last buffer the filter has settled */
+  {
+    GstBuffer *outbuffer = (GstBuffer *) g_list_last (buffers)->data;
+    GstMapInfo map;
+
+    fail_unless (gst_buffer_map (outbuffer, &map, GST_MAP_READ));
+    for (i = 0; i < N_FRAMES; i++)
+      fail_unless (ABS (((gfloat *) map.data)[i]) < 0.26f);
+    gst_buffer_unmap (outbuffer, &map);
+  }
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+/* switching the emphasis off and back on starts the filter over, as if
+ * it had never run, instead of picking up the state it had before */
+GST_START_TEST (test_emphasis_restart)
+{
+  GstElement *delta = setup_delta ();
+  gfloat in[N_FRAMES], other[N_FRAMES], first[N_FRAMES];
+  gint i;
+
+  gst_util_set_object_arg (G_OBJECT (delta), "emphasis", "low-pass");
+  g_object_set (delta, "emphasis-frequency", 2000.0, "gain", 200, NULL);
+
+  set_caps (GST_AUDIO_NE (F32), 1);
+  fill_f32 (in, N_FRAMES);
+  for (i = 0; i < N_FRAMES; i++)
+    other[i] = -in[i] / 2;
+
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (in,
+              sizeof (in))) == GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 1);
+  fail_unless_equals_int (gst_buffer_extract ((GstBuffer *) buffers->data, 0,
+          first, sizeof (first)), sizeof (first));
+  gst_check_drop_buffers ();
+
+  gst_util_set_object_arg (G_OBJECT (delta), "emphasis", "none");
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (other,
+              sizeof (other))) == GST_FLOW_OK);
+  gst_check_drop_buffers ();
+
+  gst_util_set_object_arg (G_OBJECT (delta), "emphasis", "low-pass");
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (in,
+              sizeof (in))) == GST_FLOW_OK);
+  check_output (first, sizeof (first));
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+/* channels with a gain of 0 pass through untouched, the others are
+ * sharpened with their own gain, and channels past the end of the array
+ * use gain */
+GST_START_TEST (test_channel_gains)
+{
+  GstElement *delta = setup_delta ();
+  static const gfloat gains[] = { 2.0f, 0.0f, 1.0f, 0.5f };
+  gfloat in[N_FRAMES * 4], expected[N_FRAMES * 4];
+  GValue value = G_VALUE_INIT;
+  gint i;
+
+  gst_util_set_object_arg (G_OBJECT (delta), "channel-gains", "<200,0,100>");
+  g_object_set (delta, "gain", 50, NULL);
+
+  g_value_init (&value, GST_TYPE_ARRAY);
+  g_object_get_property (G_OBJECT (delta), "channel-gains", &value);
+  fail_unless_equals_int (gst_value_array_get_size (&value), 3);
+  fail_unless_equals_int (g_value_get_int (gst_value_array_get_value (&value,
+              1)), 0);
+  g_value_unset (&value);
+
+  set_caps (GST_AUDIO_NE (F32), 4);
+  fill_f32 (in, G_N_ELEMENTS (in));
+  memcpy (expected, in, sizeof (in));
+  for (i = G_N_ELEMENTS (in) - 1; i >= 4; i--)
+    expected[i] = in[i] + gains[i % 4] * (in[i] - in[i - 4]);
+
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (in,
+              sizeof (in))) == GST_FLOW_OK);
+  check_output (expected, sizeof (expected));
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+/* clearing channel-gains starts the history over, as the channels that
+ * were skipped did not keep theirs */
+GST_START_TEST (test_channel_gains_cleared)
+{
+  GstElement *delta = setup_delta ();
+  gfloat in[N_FRAMES * 2], other[N_FRAMES * 2];
+  GValue value = G_VALUE_INIT;
+  gint i;
+
+  g_object_set (delta, "low-latency", TRUE, "gain", 50, NULL);
+  gst_util_set_object_arg (G_OBJECT (delta), "channel-gains", "<200,0>");
+
+  set_caps (GST_AUDIO_NE (F32), 2);
+  fill_f32 (in, G_N_ELEMENTS (in));
+  for (i = 0; i < G_N_ELEMENTS (in); i++)
+    other[i] = -in[i] / 2;
+
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (in,
+              sizeof (in))) == GST_FLOW_OK);
+  gst_check_drop_buffers ();
+
+  g_value_init (&value, GST_TYPE_ARRAY);
+  g_object_set_property (G_OBJECT (delta), "channel-gains", &value);
+  g_value_unset (&value);
+
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (other,
+              sizeof (other))) == GST_FLOW_OK);
+  reference_f32 (other, G_N_ELEMENTS (other), 2, 0.5f);
+  check_output (other, sizeof (other));
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+/* low-latency runs in place and carries the history over, so a signal
+ * split across buffers comes out as if it had been one buffer */
+GST_START_TEST (test_low_latency)
+{
+  GstElement *delta = setup_delta ();
+  gint16 in[N_FRAMES * 2], expected[N_FRAMES * 2];
+  gsize half = sizeof (in) / 2;
+  GstBuffer *inbuffer, *outbuffer;
+  gboolean low_latency;
+
+  g_object_set (delta, "low-latency", TRUE, "gain", 150, NULL);
+  g_object_get (delta, "low-latency", &low_latency, NULL);
+  fail_unless (low_latency);
+  fail_unless (gst_base_transform_is_in_place (GST_BASE_TRANSFORM (delta)));
+
+  set_caps (GST_AUDIO_NE (S16), 2);
+  fill_s16 (in, G_N_ELEMENTS (in));
+  memcpy (expected, in, sizeof (in));
+  reference_s16 (expected, G_N_ELEMENTS (in), 2, 1.5f);
+
+  inbuffer = new_buffer (in, half);
+  fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+  fail_unless (gst_pad_push (mysrcpad, new_buffer ((guint8 *) in + half,
+              half)) == GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 2);
+
+  /* the writable input buffer was processed as it is */
+  outbuffer = (GstBuffer *) buffers->data;
+  fail_unless (outbuffer == inbuffer);
+  fail_unless (gst_buffer_memcmp (outbuffer, 0, expected, half) == 0);
+  outbuffer = (GstBuffer *) buffers->next->data;
+  fail_unless (gst_buffer_memcmp (outbuffer, 0, (guint8 *) expected + half,
+          half) == 0);
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+/* turning low-latency off and back on starts the history over, as the
+ * buffers in between did not keep it */
+GST_START_TEST (test_low_latency_restart)
+{
+  GstElement *delta = setup_delta ();
+  gint16 in[N_FRAMES * 2], other[N_FRAMES * 2], expected[N_FRAMES * 2];
+  gint i;
+
+  g_object_set (delta, "low-latency", TRUE, "gain", 150, NULL);
+
+  set_caps (GST_AUDIO_NE (S16), 2);
+  fill_s16 (in, G_N_ELEMENTS (in));
+  for (i = 0; i < G_N_ELEMENTS (in); i++)
+    other[i] = -in[i] / 2;
+  memcpy (expected, in, sizeof (in));
+  reference_s16 (expected, G_N_ELEMENTS (in), 2, 1.5f);
+
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (in,
+              sizeof (in))) == GST_FLOW_OK);
+  check_output (expected, sizeof (expected));
+
+  g_object_set (delta, "low-latency", FALSE, NULL);
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (other,
+              sizeof (other))) == GST_FLOW_OK);
+  gst_check_drop_buffers ();
+
+  g_object_set (delta, "low-latency", TRUE, NULL);
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (in,
+              sizeof (in))) == GST_FLOW_OK);
+  check_output (expected, sizeof (expected));
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+/* dither only changes how the result is rounded, so every sample stays
+ * within two steps of the truncated reference */
+GST_START_TEST (test_dither)
+{
+  GstElement *delta = setup_delta ();
+  gint16 in[N_FRAMES * 2], expected[N_FRAMES * 2];
+  GstBuffer *outbuffer;
+  GstMapInfo map;
+  gint dither, i;
+
+  g_object_get (delta, "dither", &dither, NULL);
+  fail_unless_equals_int (dither, 0);
+
+  gst_util_set_object_arg (G_OBJECT (delta), "dither", "tpdf-shaped");
+  g_object_set (delta, "gain", 150, NULL);
+  g_object_get (delta, "dither", &dither, NULL);
+  fail_unless_equals_int (dither, 2);
+
+  set_caps (GST_AUDIO_NE (S16), 2);
+  fill_s16 (in, G_N_ELEMENTS (in));
+  memcpy (expected, in, sizeof (in));
+  reference_s16 (expected, G_N_ELEMENTS (in), 2, 1.5f);
+
+  fail_unless (gst_pad_push (mysrcpad, new_buffer (in,
+              sizeof (in))) == GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 1);
+  outbuffer = (GstBuffer *) buffers->data;
+  fail_unless (gst_buffer_map (outbuffer, &map, GST_MAP_READ));
+  for (i = 0; i < G_N_ELEMENTS (in); i++)
+    fail_unless (ABS (((gint16 *) map.data)[i] - expected[i]) <= 2);
+  gst_buffer_unmap (outbuffer, &map);
+
+  cleanup_delta (delta);
+}
+
+GST_END_TEST;
+
+static Suite *
+delta_suite (void)
+{
+  Suite *s = suite_create ("delta");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_in_place);
+  tcase_add_test (tc_chain, test_copy);
+  tcase_add_test (tc_chain, test_in_place_not_writable);
+  tcase_add_test (tc_chain, test_renegotiation);
+  tcase_add_test (tc_chain, test_clip_mode);
+  tcase_add_test (tc_chain, test_emphasis);
+  tcase_add_test (tc_chain, test_emphasis_restart);
+  tcase_add_test (tc_chain, test_channel_gains);
+  tcase_add_test (tc_chain, test_channel_gains_cleared);
+  tcase_add_test (tc_chain, test_low_latency);
+  tcase_add_test (tc_chain, test_low_latency_restart);
+  tcase_add_test (tc_chain, test_dither);
+
+  return s;
+}
+
+GST_CHECK_MAIN (delta);
@@ -0,0 +1,233 @@
+/* GStreamer
+ *
+ * per-buffer cost of the delta element on small buffers
+ *
+ * Pushes buffers of a few frames through the element, once as it runs by
+ * default and once with low-latency set, and prints the time each buffer
+ * takes, next to the time the element took before low-latency existed
+ * when that has been recorded.  Timings are noisy on a shared machine, so
+ * a slower result only fails the run when it is slower by more than
+ * DELTA_PERF_THRESHOLD (a fraction, 0.25 by default), the same margin as
+ * the kernel perf gate.  Low-latency has to beat both the default mode and
+ * the recorded element.
+ *
+ * The recorded element is read from the file named by
+ * DELTA_LATENCY_BASELINE.  Run against a build of the element without a
+ * low-latency property, the test measures that element instead and writes
+ * the file; tests/check/Makefile.am has a latency-baseline target for it.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <gst/check/gstharness.h>
+
+#define N_CHANNELS 2
+#define N_BUFFERS 20000
+#define N_WARMUP 1000
+#define N_RUNS 5
+#define DEFAULT_THRESHOLD 0.25
+
+static const gint test_frames[] = { 32, 128 };
+
+/* best of N_RUNS, in nanoseconds per buffer.  The output buffer is pushed
+ * back in as the next input, so every mode sees the same buffer life cycle
+ * as in a pipeline, and only what the element does differs.  low_latency
+ * is not set on an element that does not have it. */
+static gdouble
+measure (gint frames, gboolean low_latency)
+{
+  GstHarness *h = gst_harness_new ("delta");
+  gsize size = frames * N_CHANNELS * sizeof (gint16);
+  gdouble best = G_MAXDOUBLE;
+  GstBuffer *buffer;
+  gint run, i;
+
+  if (low_latency)
+    g_object_set (h->element, "low-latency", TRUE, NULL);
+  gst_harness_set_src_caps_str (h, "audio/x-raw, format = (string) "
+      GST_AUDIO_NE (S16) ", layout = (string) interleaved, "
+      "rate = (int) 48000, channels = (int) 2");
+
+  buffer = gst_harness_create_buffer (h, size);
+  gst_buffer_memset (buffer, 0, 0x10, size);
+
+  for (i = 0; i < N_WARMUP; i++) {
+    gst_harness_push (h, buffer);
+    buffer = gst_harness_pull (h);
+  }
+
+  for (run = 0; run < N_RUNS; run++) {
+    gint64 start = g_get_monotonic_time ();
+
+    for (i = 0; i < N_BUFFERS; i++) {
+      gst_harness_push (h, buffer);
+      buffer = gst_harness_pull (h);
+    }
+    best = MIN (best, (g_get_monotonic_time () - start) * 1000.0 / N_BUFFERS);
+  }
+
+  gst_buffer_unref (buffer);
+  gst_harness_teardown (h);
+
+  return best;
+}
+
+/* the baseline is a "host <name>" line followed by "<frames> <ns>" lines,
+ * in the order of test_frames */
+static gboolean
+read_baseline (const gchar * filename, gdouble * today)
+{
+  gchar *contents, **lines;
+  gboolean complete = TRUE;
+  guint f;
+
+  if (!g_file_get_contents (filename, &contents, NULL, NULL))
+    return FALSE;
+
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  if (lines[0] == NULL || !g_str_has_prefix (lines[0], "host ")
+      || strcmp (lines[0] + 5, g_get_host_name ()) != 0) {
+    g_print ("baseline %s was recorded on another host\n", filename);
+    g_strfreev (lines);
+    return FALSE;
+  }
+
+  for (f = 0; f < G_N_ELEMENTS (test_frames) && complete; f++) {
+    gchar **fields = lines[f + 1] != NULL ?
+        g_strsplit (lines[f + 1], " ", 2) : NULL;
+
+    complete = fields != NULL && fields[0] != NULL && fields[1] != NULL
+        && atoi (fields[0]) == test_frames[f];
+    if (complete)
+      today[f] = g_ascii_strtod (fields[1], NULL);
+    g_strfreev (fields);
+  }
+  g_strfreev (lines);
+
+  return complete;
+}
+
+static gboolean
+write_baseline (const gchar * filename, const gdouble * today)
+{
+  GString *contents = g_string_new (NULL);
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  GError *error = NULL;
+  guint f;
+
+  g_string_append_printf (contents, "host %s\n", g_get_host_name ());
+  for (f = 0; f < G_N_ELEMENTS (test_frames); f++) {
+    g_string_append_printf (contents, "%d %s\n", test_frames[f],
+        g_ascii_dtostr (buf, sizeof (buf), today[f]));
+  }
+
+  if (!g_file_set_contents (filename, contents->str, -1, &error)) {
+    g_printerr ("could not write baseline %s: %s\n", filename,
+        error->message);
+    g_error_free (error);
+    g_string_free (contents, TRUE);
+    return FALSE;
+  }
+
+  g_print ("recorded baseline %s\n", filename);
+  g_string_free (contents, TRUE);
+  return TRUE;
+}
+
+/* an element from before low-latency is what the baseline records */
+static gboolean
+has_low_latency (void)
+{
+  GstElement *element = gst_element_factory_make ("delta", NULL);
+  gboolean found;
+
+  if (element == NULL) {
+    g_printerr ("no delta element\n");
+    exit (EXIT_FAILURE);
+  }
+
+  found = g_object_class_find_property (G_OBJECT_GET_CLASS (element),
+      "low-latency") != NULL;
+  gst_object_unref (element);
+
+  return found;
+}
+
+static gboolean
+check_slower (const gchar * what, gdouble cost, gdouble reference,
+    gdouble threshold)
+{
+  gboolean slower = cost > reference * (1.0 + threshold);
+
+  g_print (", %s %8.1f%s", what, reference,
+      slower ? " SLOWER" : cost >= reference ? " (within margin)" : "");
+
+  return slower;
+}
+
+int
+main (int argc, char **argv)
+{
+  const gchar *filename = g_getenv ("DELTA_LATENCY_BASELINE");
+  const gchar *threshold_env = g_getenv ("DELTA_PERF_THRESHOLD");
+  gdouble threshold = DEFAULT_THRESHOLD;
+  gdouble today[G_N_ELEMENTS (test_frames)];
+  gboolean have_today = FALSE;
+  gboolean failed = FALSE;
+  guint f;
+
+  gst_init (&argc, &argv);
+
+  if (threshold_env != NULL)
+    threshold = g_ascii_strtod (threshold_env, NULL);
+
+  if (!has_low_latency ()) {
+    for (f = 0; f < G_N_ELEMENTS (test_frames); f++) {
+      today[f] = measure (test_frames[f], FALSE);
+      g_print ("%4d frames: %8.1f ns/buffer\n", test_frames[f], today[f]);
+    }
+    if (filename == NULL) {
+      g_printerr ("DELTA_LATENCY_BASELINE is not set\n");
+      return EXIT_FAILURE;
+    }
+    return write_baseline (filename, today) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if (filename != NULL)
+    have_today = read_baseline (filename, today);
+  if (!have_today)
+    g_print ("no baseline of the element before low-latency\n");
+
+  for (f = 0; f < G_N_ELEMENTS (test_frames); f++) {
+    gdouble plain = measure (test_frames[f], FALSE);
+    gdouble low_latency = measure (test_frames[f], TRUE);
+
+    g_print ("%4d frames, ns/buffer: low-latency %8.1f", test_frames[f],
+        low_latency);
+    failed |= check_slower ("default", low_latency, plain, threshold);
+    if (have_today)
+      failed |= check_slower ("before low-latency", low_latency, today[f], threshold);
+    g_print ("\n");
+  }
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,990 @@
+/* GStreamer
+ *
+ * unit test for the delta sample kernels
+ *
+ * Every kernel in delta.c is run over randomized and edge-case input and
+ * compared against a plain reference implementation of the delta filter.
+ * Integer formats have to match exactly, float formats within MAX_ULPS.
+ * With emphasis the recursive filter may carry a difference in fused
+ * multiply-add contraction forward, so integers may be off by one step and
+ * floats by EMPHASIS_ULPS.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <gst/check/gstcheck.h>
+
+#include "delta.h"
+
+/* allow for fused multiply-add contraction on platforms that do it */
+#define MAX_ULPS 2
+#define EMPHASIS_ULPS 16
+/* the 8 and 16 bit kernels soft clip in gfloat, so a result that lies
+ * within gfloat rounding of an integer can be truncated to its neighbour */
+#define GFLOAT_LSBS 1
+
+#define RANDOM_SEED 0x64656c74
+
+typedef enum
+{
+  PATTERN_RANDOM,
+  PATTERN_FULL_SCALE,
+  PATTERN_SILENCE,
+  PATTERN_ALTERNATING,
+  PATTERN_SUBNORMAL
+} Pattern;
+
+typedef gpointer (*KernelFunc) (void *buf, gint n_samples, gint nch,
+    gfloat gain, const DeltaChannelGains * channel_gains,
+    DeltaClipMode clip_mode, DeltaEmphasis * emphasis, DeltaDither * dither);
+typedef void (*ReferenceFunc) (gpointer buf, gint n_samples, gint nch,
+    gfloat gain, DeltaClipMode clip_mode, const DeltaEmphasis * emphasis);
+typedef void (*SweepFunc) (gpointer buf, gint n_samples);
+typedef gboolean (*CurveFunc) (gconstpointer input, gconstpointer output,
+    gint n_samples, gint * index);
+typedef void (*FillFunc) (gpointer buf, gint n_samples, gint nch,
+    Pattern pattern, GRand * rand);
+typedef gboolean (*CompareFunc) (gconstpointer expected, gconstpointer actual,
+    gint n_samples, gint tolerance, gint * index);
+
+typedef struct
+{
+  const gchar *name;
+  gint nbytes;
+  KernelFunc kernel;
+  ReferenceFunc reference;
+  FillFunc fill;
+  CompareFunc compare;
+  gint tolerance;
+  gint soft_tolerance;
+  gint emphasis_tolerance;
+  SweepFunc sweep;
+  CurveFunc check_curve;
+} KernelInfo;
+
+static const gint test_channels[] = { 1, 2, 6, 8 };
+static const gint test_frames[] = { 1, 2, 7, 1024 };
+static const gfloat test_gains[] = { 0.0f, 0.01f, 0.5f, 1.0f, 1.5f, 2.0f };
+static const DeltaClipMode test_clip_modes[] = { DELTA_CLIP_HARD,
+  DELTA_CLIP_SOFT
+};
+static const DeltaEmphasisType test_emphases[] = { DELTA_EMPHASIS_NONE,
+  DELTA_EMPHASIS_LOW_PASS, DELTA_EMPHASIS_HIGH_SHELF
+};
+
+#define TEST_RATE 48000
+
+#define CURVE_POINTS 4096
+
+/* The soft clip curve written out piecewise: unchanged up to the knee, a
+ * parabola over width and flat from there on.  NaN is left as it is. */
+#define DEFINE_REFERENCE_SOFT_CLIP(name, type)                              \
+static type                                                                 \
+name (type x, type center, type full)                                       \
+{                                                                           \
+  type knee = DELTA_SOFT_CLIP_KNEE * full;                                  \
+  type width = 2.0 * (full - knee);                                         \
+  type dev = x - center;                                                    \
+  type over = (dev < 0 ? -dev : dev) - knee;                                \
+  type distance;                                                            \
+                                                                            \
+  if (!(over > 0))                                                          \
+    return x;                                                               \
+  else if (over < width)                                                    \
+    distance = knee + over - over * over * ((type) 0.5 / width);            \
+  else                                                                      \
+    distance = knee + width - width * width * ((type) 0.5 / width);         \
+                                                                            \
+  return dev < 0 ? center - distance : center + distance;                   \
+}
+
+DEFINE_REFERENCE_SOFT_CLIP (reference_soft_clip, gdouble);
+DEFINE_REFERENCE_SOFT_CLIP (reference_soft_clipf, gfloat);
+
+/* The emphasis filter: transposed direct form II biquads, one after the
+ * other, with two state values per stage in z. */
+static gdouble
+reference_filter (gdouble x, const DeltaEmphasis * emphasis, gdouble * z)
+{
+  gint s;
+
+  for (s = 0; emphasis != NULL && s < emphasis->n_stages; s++) {
+    const DeltaBiquad *bq = &emphasis->stages[s];
+    gdouble y = bq->b0 * x + z[2 * s];
+
+    z[2 * s] = bq->b1 * x - bq->a1 * y + z[2 * s + 1];
+    z[2 * s + 1] = bq->b2 * x - bq->a2 * y;
+    x = y;
+  }
+  return x;
+}
+
+/* The soft clip must leave samples below the knee alone, never make a
+ * sample louder, keep the curve monotonic and stay within full scale.
+ * input is a sweep over the whole range in ascending order, without NaN,
+ * so none may come out either. */
+#define CHECK_CURVE(type, center, full)                                     \
+  const type *x = input, *y = output;                                       \
+  gint i;                                                                   \
+                                                                            \
+  for (i = 0; i < n_samples; i++) {                                         \
+    gdouble dx = (gdouble) x[i] - (center);                                 \
+    gdouble dy = (gdouble) y[i] - (center);                                 \
+                                                                            \
+    if ((ABS (dx) <= DELTA_SOFT_CLIP_KNEE * (full) && x[i] != y[i])         \
+        || y[i] != y[i] || ABS (dy) > ABS (dx) || ABS (dy) > (full)         \
+        || (i > 0 && y[i] < y[i - 1])) {                                    \
+      *index = i;                                                           \
+      return FALSE;                                                         \
+    }                                                                       \
+  }                                                                         \
+  return TRUE;
+
+/* The reference computes in gdouble and saturates to the type range.  The
+ * reference saturates explicitly instead of relying on CLAMP so that the
+ * 64 bit bounds, which are not representable as gdouble, are covered.
+ * Full scale for the soft clip is the distance from silence to hi. */
+#define DEFINE_INT_KERNEL(name, type, lo, hi, silence)                      \
+static void                                                                 \
+reference_##name (gpointer buf, gint n_samples, gint nch, gfloat gain,      \
+    DeltaClipMode clip_mode, const DeltaEmphasis * emphasis)                \
+{                                                                           \
+  type *samples = buf;                                                      \
+  gdouble *prev = g_new (gdouble, nch);                                     \
+  gdouble *z = g_new0 (gdouble, 2 * DELTA_EMPHASIS_MAX_STAGES * nch);       \
+  gdouble full = (gdouble) (hi) - (gdouble) (silence);                      \
+  gint i, j;                                                                \
+                                                                            \
+  for (j = 0; j < nch && j < n_samples; j++)                                \
+    prev[j] = (gdouble) samples[j];                                         \
+                                                                            \
+  for (i = nch; i < n_samples; i += nch) {                                  \
+    for (j = 0; j < nch; j++) {                                             \
+      gdouble curr = (gdouble) samples[i + j];                              \
+      gdouble diff = reference_filter (curr - prev[j], emphasis,            \
+          &z[2 * DELTA_EMPHASIS_MAX_STAGES * j]);                           \
+      gdouble result = curr + (gain * diff);                                \
+                                                                            \
+      prev[j] = curr;                                                       \
+      if (clip_mode == DELTA_CLIP_SOFT)                                     \
+        result = reference_soft_clip (result, (gdouble) (silence), full);   \
+      if (result >= (gdouble) (hi))                                         \
+        samples[i + j] = (hi);                                              \
+      else if (result <= (gdouble) (lo))                                    \
+        samples[i + j] = (lo);                                              \
+      else                                                                  \
+        samples[i + j] = (type) result;                                     \
+    }                                                                       \
+  }                                                                         \
+  g_free (prev);                                                            \
+  g_free (z);                                                               \
+}                                                                           \
+                                                                            \
+static void                                                                 \
+fill_##name (gpointer buf, gint n_samples, gint nch, Pattern pattern,       \
+    GRand * rand)                                                           \
+{                                                                           \
+  type *samples = buf;                                                      \
+  gint i;                                                                   \
+                                                                            \
+  for (i = 0; i < n_samples; i++) {                                         \
+    gint frame = i / nch;                                                   \
+                                                                            \
+    switch (pattern) {                                                      \
+      case PATTERN_RANDOM:{                                                 \
+        guint64 r = ((guint64) g_rand_int (rand) << 32) | g_rand_int (rand); \
+        memcpy (&samples[i], &r, sizeof (type));                            \
+        break;                                                              \
+      }                                                                     \
+      case PATTERN_FULL_SCALE:                                              \
+        samples[i] = ((frame / 8) % 2) ? (lo) : (hi);                       \
+        break;                                                              \
+      case PATTERN_SILENCE:                                                 \
+        samples[i] = (silence);                                             \
+        break;                                                              \
+      case PATTERN_ALTERNATING:                                             \
+        samples[i] = (frame % 2) ? (lo) : (hi);                             \
+        break;                                                              \
+      case PATTERN_SUBNORMAL:                                               \
+        /* the smallest steps around silence */                             \
+        samples[i] = (silence) + g_rand_int_range (rand, -1, 2);            \
+        break;                                                              \
+    }                                                                       \
+  }                                                                         \
+}                                                                           \
+                                                                            \
+static gboolean                                                             \
+compare_##name (gconstpointer expected, gconstpointer actual,               \
+    gint n_samples, gint tolerance, gint * index)                           \
+{                                                                           \
+  const type *e = expected, *a = actual;                                    \
+  gint i;                                                                   \
+                                                                            \
+  for (i = 0; i < n_samples; i++) {                                         \
+    if ((e[i] > a[i] ? (guint64) e[i] - (guint64) a[i]                      \
+            : (guint64) a[i] - (guint64) e[i]) > (guint64) tolerance) {     \
+      *index = i;                                                           \
+      return FALSE;                                                         \
+    }                                                                       \
+  }                                                                         \
+  return TRUE;                                                              \
+}                                                                           \
+                                                                            \
+static void                                                                 \
+sweep_##name (gpointer buf, gint n_samples)                                 \
+{                                                                           \
+  type *samples = buf;                                                      \
+  gint i;                                                                   \
+                                                                            \
+  for (i = 0; i < n_samples; i++) {                                         \
+    gdouble v = (gdouble) (lo) +                                            \
+        ((gdouble) (hi) - (gdouble) (lo)) * i / (n_samples - 1);            \
+                                                                            \
+    samples[i] = (v >= (gdouble) (hi)) ? (hi) : (type) v;                   \
+  }                                                                         \
+}                                                                           \
+                                                                            \
+static gboolean                                                             \
+check_curve_##name (gconstpointer input, gconstpointer output,              \
+    gint n_samples, gint * index)                                           \
+{                                                                           \
+  CHECK_CURVE (type, (gdouble) (silence),                                   \
+      (gdouble) (hi) - (gdouble) (silence));                                \
+}
+
+DEFINE_INT_KERNEL (s8, gint8, G_MININT8, G_MAXINT8, 0);
+DEFINE_INT_KERNEL (u8, guint8, 0, G_MAXUINT8, 1U << 7);
+DEFINE_INT_KERNEL (s16, gint16, G_MININT16, G_MAXINT16, 0);
+DEFINE_INT_KERNEL (u16, guint16, 0, G_MAXUINT16, 1U << 15);
+DEFINE_INT_KERNEL (s32, gint32, G_MININT32, G_MAXINT32, 0);
+DEFINE_INT_KERNEL (u32, guint32, 0, G_MAXUINT32, 1U << 31);
+DEFINE_INT_KERNEL (s64, gint64, G_MININT64, G_MAXINT64, 0);
+DEFINE_INT_KERNEL (u64, guint64, 0, G_MAXUINT64, G_GUINT64_CONSTANT (1) << 63);
+
+/* Map the bit pattern of a float onto a monotonic integer scale so that
+ * the distance between two values is their distance in ULPs. */
+#define DEFINE_FLOAT_KERNEL(name, type, utype, maxval, minval, soft_clip)   \
+static void                                                                 \
+reference_emphasis_##name (type * samples, gint n_samples, gint nch,        \
+    gfloat gain, DeltaClipMode clip_mode, const DeltaEmphasis * emphasis)   \
+{                                                                           \
+  gdouble *prev = g_new (gdouble, nch);                                     \
+  gdouble *z = g_new0 (gdouble, 2 * DELTA_EMPHASIS_MAX_STAGES * nch);       \
+  gint i, j;                                                                \
+                                                                            \
+  for (j = 0; j < nch && j < n_samples; j++)                                \
+    prev[j] = samples[j];                                                   \
+                                                                            \
+  for (i = nch; i < n_samples; i += nch) {                                  \
+    for (j = 0; j < nch; j++) {                                             \
+      gdouble curr = samples[i + j];                                        \
+      gdouble diff = reference_filter (curr - prev[j], emphasis,            \
+          &z[2 * DELTA_EMPHASIS_MAX_STAGES * j]);                           \
+      gdouble result = curr + (gain * diff);                                \
+                                                                            \
+      prev[j] = curr;                                                       \
+      if (clip_mode == DELTA_CLIP_SOFT)                                     \
+        result = reference_soft_clip (result, 0.0, 1.0);                    \
+      if (result > (maxval))                                                \
+        result = (maxval);                                                  \
+      else if (result < -(maxval))                                          \
+        result = -(maxval);                                                 \
+      samples[i + j] = (type) result;                                       \
+    }                                                                       \
+  }                                                                         \
+  g_free (prev);                                                            \
+  g_free (z);                                                               \
+}                                                                           \
+                                                                            \
+static void                                                                 \
+reference_##name (gpointer buf, gint n_samples, gint nch, gfloat gain,      \
+    DeltaClipMode clip_mode, const DeltaEmphasis * emphasis)                \
+{                                                                           \
+  type *samples = buf;                                                      \
+  type *prev = g_new (type, nch);                                           \
+  gdouble *z = g_new0 (gdouble, 2 * DELTA_EMPHASIS_MAX_STAGES * nch);       \
+  gint i, j;                                                                \
+                                                                            \
+  if (emphasis != NULL && emphasis->n_stages > 0) {                         \
+    /* the emphasis runs in gdouble for every sample type */                \
+    reference_emphasis_##name (samples, n_samples, nch, gain, clip_mode,    \
+        emphasis);                                                          \
+    g_free (prev);                                                          \
+    g_free (z);                                                             \
+    return;                                                                 \
+  }                                                                         \
+                                                                            \
+  for (j = 0; j < nch && j < n_samples; j++)                                \
+    prev[j] = samples[j];                                                   \
+                                                                            \
+  for (i = nch; i < n_samples; i += nch) {                                  \
+    for (j = 0; j < nch; j++) {                                             \
+      type curr = samples[i + j];                                           \
+      type result = curr + (gain * (curr - prev[j]));                       \
+                                                                            \
+      prev[j] = curr;                                                       \
+      if (clip_mode == DELTA_CLIP_SOFT)                                     \
+        result = soft_clip (result, 0.0, 1.0);                              \
+      if (result > (maxval))                                                \
+        result = (maxval);                                                  \
+      else if (result < -(maxval))                                          \
+        result = -(maxval);                                                 \
+      samples[i + j] = result;                                              \
+    }                                                                       \
+  }                                                                         \
+  g_free (prev);                                                            \
+  g_free (z);                                                               \
+}                                                                           \
+                                                                            \
+static void                                                                 \
+fill_##name (gpointer buf, gint n_samples, gint nch, Pattern pattern,       \
+    GRand * rand)                                                           \
+{                                                                           \
+  type *samples = buf;                                                      \
+  gint i;                                                                   \
+                                                                            \
+  for (i = 0; i < n_samples; i++) {                                         \
+    gint frame = i / nch;                                                   \
+                                                                            \
+    switch (pattern) {                                                      \
+      case PATTERN_RANDOM:                                                  \
+        samples[i] = (type) g_rand_double_range (rand, -1.0, 1.0);          \
+        break;                                                              \
+      case PATTERN_FULL_SCALE:                                              \
+        samples[i] = ((frame / 8) % 2) ? -1.0 : 1.0;                        \
+        break;                                                              \
+      case PATTERN_SILENCE:                                                 \
+        samples[i] = 0.0;                                                   \
+        break;                                                              \
+      case PATTERN_ALTERNATING:                                             \
+        samples[i] = (frame % 2) ? -(maxval) : (maxval);                    \
+        break;                                                              \
+      case PATTERN_SUBNORMAL:                                               \
+        samples[i] = (type) g_rand_double_range (rand, -1.0, 1.0) * (minval); \
+        break;                                                              \
+    }                                                                       \
+  }                                                                         \
+}                                                                           \
+                                                                            \
+static void                                                                 \
+sweep_##name (gpointer buf, gint n_samples)                                 \
+{                                                                           \
+  type *samples = buf;                                                      \
+  gint i;                                                                   \
+                                                                            \
+  /* from -2 to 2 times full scale, with an eighth of the points at         \
+   * either end stepping out from there to the largest value.  Infinity     \
+   * would turn into NaN at gain 0 before the clip; the alternating         \
+   * pattern overflows into it instead. */                                  \
+  gint tail = n_samples / 8, body = n_samples - 2 * tail;                   \
+                                                                            \
+  for (i = 0; i < n_samples; i++) {                                         \
+    gint k = (i < tail) ? tail - i : MAX (i - tail - body + 1, 0);          \
+    gdouble v;                                                              \
+                                                                            \
+    if (k == 0)                                                             \
+      v = -2.0 + 4.0 * (i - tail) / (body - 1);                             \
+    else                                                                    \
+      v = 2.0 * pow ((maxval) / 2.0, (gdouble) k / tail);                   \
+    samples[i] = (type) ((i < tail) ? -v : v);                              \
+  }                                                                         \
+}                                                                           \
+                                                                            \
+static gboolean                                                             \
+check_curve_##name (gconstpointer input, gconstpointer output,              \
+    gint n_samples, gint * index)                                           \
+{                                                                           \
+  CHECK_CURVE (type, 0.0, 1.0);                                             \
+}                                                                           \
+                                                                            \
+static utype                                                                \
+ordered_##name (type value)                                                 \
+{                                                                           \
+  const utype sign = (utype) 1 << (sizeof (utype) * 8 - 1);                \
+  utype bits;                                                               \
+                                                                            \
+  memcpy (&bits, &value, sizeof (bits));                                    \
+  return (bits & sign) ? ~bits : (bits | sign);                             \
+}                                                                           \
+                                                                            \
+static gboolean                                                             \
+compare_##name (gconstpointer expected, gconstpointer actual,               \
+    gint n_samples, gint tolerance, gint * index)                           \
+{                                                                           \
+  const type *e = expected, *a = actual;                                    \
+  gint i;                                                                   \
+                                                                            \
+  for (i = 0; i < n_samples; i++) {                                         \
+    utype oe, oa;                                                           \
+                                                                            \
+    oe = ordered_##name (e[i]);                                             \
+    oa = ordered_##name (a[i]);                                             \
+    if ((oe > oa ? oe - oa : oa - oe) > (utype) tolerance) {                \
+      *index = i;                                                           \
+      return FALSE;                                                         \
+    }                                                                       \
+  }                                                                         \
+  return TRUE;                                                              \
+}
+
+DEFINE_FLOAT_KERNEL (f32, gfloat, guint32, G_MAXFLOAT, G_MINFLOAT,
+    reference_soft_clipf);
+DEFINE_FLOAT_KERNEL (f64, gdouble, guint64, G_MAXDOUBLE, G_MINDOUBLE,
+    reference_soft_clip);
+
+#define KERNEL(func, name, type, tolerance, soft_tolerance, \
+    emphasis_tolerance) \
+  { #func, sizeof (type), (KernelFunc) func, reference_##name, fill_##name, \
+    compare_##name, tolerance, soft_tolerance, emphasis_tolerance, \
+    sweep_##name, check_curve_##name }
+
+static const KernelInfo kernels[] = {
+  KERNEL (process8, s8, gint8, 0, GFLOAT_LSBS, 1),
+  KERNEL (process8u, u8, guint8, 0, GFLOAT_LSBS, 1),
+  KERNEL (process16, s16, gint16, 0, GFLOAT_LSBS, 1),
+  KERNEL (process16u, u16, guint16, 0, GFLOAT_LSBS, 1),
+  KERNEL (process32, s32, gint32, 0, 0, 1),
+  KERNEL (process32u, u32, guint32, 0, 0, 1),
+  KERNEL (process64, s64, gint64, 0, 0, 1),
+  KERNEL (process64u, u64, guint64, 0, 0, 1),
+  KERNEL (processf, f32, gfloat, MAX_ULPS, MAX_ULPS, EMPHASIS_ULPS),
+  KERNEL (processd, f64, gdouble, MAX_ULPS, MAX_ULPS, EMPHASIS_ULPS),
+};
+
+static gint
+tolerance_for (const KernelInfo * info, DeltaEmphasisType emphasis,
+    DeltaClipMode clip_mode)
+{
+  if (emphasis != DELTA_EMPHASIS_NONE)
+    return info->emphasis_tolerance;
+  return clip_mode == DELTA_CLIP_SOFT ? info->soft_tolerance : info->tolerance;
+}
+
+static void
+check_pattern (Pattern pattern)
+{
+  GRand *rand = g_rand_new_with_seed (RANDOM_SEED);
+  DeltaEmphasis emphasis;
+  guint k, c, f, g, m, e;
+
+  delta_emphasis_init (&emphasis);
+
+  for (k = 0; k < G_N_ELEMENTS (kernels); k++) {
+    const KernelInfo *info = &kernels[k];
+
+    for (c = 0; c < G_N_ELEMENTS (test_channels); c++) {
+      for (f = 0; f < G_N_ELEMENTS (test_frames); f++) {
+        gint nch = test_channels[c];
+        gint n_samples = test_frames[f] * nch;
+        gsize size = n_samples * info->nbytes;
+        gpointer input = g_malloc (size);
+        gpointer expected = g_malloc (size);
+        gpointer actual = g_malloc (size);
+
+        info->fill (input, n_samples, nch, pattern, rand);
+        delta_emphasis_set_channels (&emphasis, nch);
+
+        for (e = 0; e < G_N_ELEMENTS (test_emphases); e++) {
+          delta_emphasis_design (&emphasis, test_emphases[e], TEST_RATE,
+              4000.0, -12.0);
+
+          for (g = 0; g < G_N_ELEMENTS (test_gains); g++) {
+            for (m = 0; m < G_N_ELEMENTS (test_clip_modes); m++) {
+              DeltaClipMode clip_mode = test_clip_modes[m];
+              gint index = -1;
+
+              memcpy (expected, input, size);
+              memcpy (actual, input, size);
+              delta_emphasis_reset (&emphasis);
+              info->reference (expected, n_samples, nch, test_gains[g],
+                  clip_mode, &emphasis);
+              info->kernel (actual, n_samples, nch, test_gains[g], NULL,
+                  clip_mode, &emphasis, NULL);
+
+              fail_unless (info->compare (expected, actual, n_samples,
+                      tolerance_for (info, test_emphases[e], clip_mode),
+                      &index),
+                  "%s: pattern %d, emphasis %d, clip mode %d, %d channels, "
+                  "%d frames, gain %f: mismatch at sample %d", info->name,
+                  pattern, test_emphases[e], clip_mode, nch, test_frames[f],
+                  test_gains[g], index);
+            }
+          }
+        }
+
+        g_free (input);
+        g_free (expected);
+        g_free (actual);
+      }
+    }
+  }
+
+  delta_emphasis_clear (&emphasis);
+  g_rand_free (rand);
+}
+
+GST_START_TEST (test_random)
+{
+  check_pattern (PATTERN_RANDOM);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_full_scale)
+{
+  check_pattern (PATTERN_FULL_SCALE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_silence)
+{
+  check_pattern (PATTERN_SILENCE);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_alternating_extremes)
+{
+  check_pattern (PATTERN_ALTERNATING);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_subnormal)
+{
+  check_pattern (PATTERN_SUBNORMAL);
+}
+
+GST_END_TEST;
+
+/* With gain 0 the kernels only apply the clip, so a single frame of
+ * CURVE_POINTS channels after a frame of silence samples the curve. */
+GST_START_TEST (test_soft_clip_curve)
+{
+  guint k;
+
+  for (k = 0; k < G_N_ELEMENTS (kernels); k++) {
+    const KernelInfo *info = &kernels[k];
+    gsize frame_size = CURVE_POINTS * info->nbytes;
+    guint8 *input = g_malloc (frame_size);
+    guint8 *samples = g_malloc (2 * frame_size);
+    gint index = -1;
+
+    info->sweep (input, CURVE_POINTS);
+    info->fill (samples, CURVE_POINTS, CURVE_POINTS, PATTERN_SILENCE, NULL);
+    memcpy (samples + frame_size, input, frame_size);
+
+    info->kernel (samples, 2 * CURVE_POINTS, CURVE_POINTS, 0.0f, NULL,
+        DELTA_CLIP_SOFT, NULL, NULL);
+
+    fail_unless (info->check_curve (input, samples + frame_size,
+            CURVE_POINTS, &index), "%s: bad soft clip curve at point %d",
+        info->name, index);
+
+    g_free (input);
+    g_free (samples);
+  }
+}
+
+GST_END_TEST;
+
+/* Filter and dither state carry over between buffers, so processing a
+ * signal in pieces has to give the same result as processing it in one
+ * go. */
+static const DeltaDitherMode test_dithers[] = { DELTA_DITHER_NONE,
+  DELTA_DITHER_TPDF, DELTA_DITHER_TPDF_SHAPED
+};
+
+GST_START_TEST (test_emphasis_split)
+{
+  GRand *rand = g_rand_new_with_seed (RANDOM_SEED);
+  DeltaEmphasis whole, split;
+  DeltaDither whole_dither, split_dither;
+  guint k, e, d;
+
+  delta_emphasis_init (&whole);
+  delta_emphasis_init (&split);
+  delta_emphasis_set_channels (&whole, 2);
+  delta_emphasis_set_channels (&split, 2);
+  delta_dither_init (&whole_dither);
+  delta_dither_init (&split_dither);
+  delta_dither_set_channels (&whole_dither, 2);
+  delta_dither_set_channels (&split_dither, 2);
+
+  for (k = 0; k < G_N_ELEMENTS (kernels); k++) {
+    const KernelInfo *info = &kernels[k];
+    gint n_samples = 2 * 1024;
+    gsize size = n_samples * info->nbytes;
+    guint8 *input = g_malloc (size);
+    guint8 *expected = g_malloc (size);
+    guint8 *actual = g_malloc (size);
+
+    info->fill (input, n_samples, 2, PATTERN_RANDOM, rand);
+
+    /* without a filter, a continuous emphasis has to match the plain
+     * loop run over the whole signal at once */
+    whole.continuous = split.continuous = TRUE;
+    for (e = 0; e < G_N_ELEMENTS (test_emphases); e++) {
+      for (d = 0; d < G_N_ELEMENTS (test_dithers); d++) {
+        gint index = -1;
+
+        delta_emphasis_design (&whole, test_emphases[e], TEST_RATE, 4000.0,
+            -12.0);
+        delta_emphasis_design (&split, test_emphases[e], TEST_RATE, 4000.0,
+            -12.0);
+        delta_emphasis_reset (&whole);
+        delta_emphasis_reset (&split);
+        whole_dither.mode = split_dither.mode = test_dithers[d];
+        delta_dither_reset (&whole_dither);
+        delta_dither_reset (&split_dither);
+
+        memcpy (expected, input, size);
+        memcpy (actual, input, size);
+        info->kernel (expected, n_samples, 2, 1.5f, NULL, DELTA_CLIP_HARD,
+            &whole, &whole_dither);
+        /* 3 + 2 + 1019 frames */
+        info->kernel (actual, 6, 2, 1.5f, NULL, DELTA_CLIP_HARD, &split,
+            &split_dither);
+        info->kernel (actual + 6 * info->nbytes, 4, 2, 1.5f, NULL,
+            DELTA_CLIP_HARD, &split, &split_dither);
+        info->kernel (actual + 10 * info->nbytes, n_samples - 10, 2, 1.5f,
+            NULL, DELTA_CLIP_HARD, &split, &split_dither);
+
+        fail_unless (info->compare (expected, actual, n_samples, 0, &index),
+            "%s: emphasis %d, dither %d: split buffers differ at sample %d",
+            info->name, test_emphases[e], test_dithers[d], index);
+
+        if (test_emphases[e] == DELTA_EMPHASIS_NONE &&
+            test_dithers[d] == DELTA_DITHER_NONE) {
+          memcpy (expected, input, size);
+          info->kernel (expected, n_samples, 2, 1.5f, NULL, DELTA_CLIP_HARD,
+              NULL, NULL);
+          fail_unless (info->compare (expected, actual, n_samples,
+                  info->tolerance, &index),
+              "%s: continuous buffers differ from the plain loop at sample "
+              "%d", info->name, index);
+        }
+      }
+    }
+
+    g_free (input);
+    g_free (expected);
+    g_free (actual);
+  }
+
+  delta_dither_clear (&whole_dither);
+  delta_dither_clear (&split_dither);
+  delta_emphasis_clear (&whole);
+  delta_emphasis_clear (&split);
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+/* peak output level of a sine of the given frequency after the filter
+ * has settled */
+static gdouble
+sine_response (DeltaEmphasis * emphasis, gdouble frequency, gfloat gain)
+{
+  gint n_samples = TEST_RATE / 10;
+  gdouble *samples = g_new (gdouble, n_samples);
+  gdouble peak = 0.0;
+  gint i;
+
+  for (i = 0; i < n_samples; i++)
+    samples[i] = 0.25 * sin (2.0 * G_PI * frequency * i / TEST_RATE);
+
+  if (emphasis != NULL)
+    delta_emphasis_reset (emphasis);
+  processd (samples, n_samples, 1, gain, NULL, DELTA_CLIP_HARD, emphasis,
+      NULL);
+
+  for (i = n_samples / 2; i < n_samples; i++)
+    peak = MAX (peak, ABS (samples[i]));
+
+  g_free (samples);
+  return peak / 0.25;
+}
+
+GST_START_TEST (test_emphasis_response)
+{
+  DeltaEmphasis emphasis;
+  gdouble plain_high, plain_low;
+
+  delta_emphasis_init (&emphasis);
+  delta_emphasis_set_channels (&emphasis, 1);
+
+  /* the plain first difference lifts high frequencies a lot */
+  plain_high = sine_response (NULL, 15000.0, 2.0f);
+  plain_low = sine_response (NULL, 200.0, 2.0f);
+  fail_unless (plain_high > 3.0, "plain high gain %f", plain_high);
+
+  /* the low-pass keeps the sharpening away from 15 kHz but not from the
+   * frequencies below its corner */
+  delta_emphasis_design (&emphasis, DELTA_EMPHASIS_LOW_PASS, TEST_RATE,
+      2000.0, 0.0);
+  fail_unless (sine_response (&emphasis, 15000.0, 2.0f) < 1.05);
+  fail_unless (ABS (sine_response (&emphasis, 200.0, 2.0f) - plain_low) <
+      0.02);
+
+  /* the shelf cuts the sharpening above its corner by the shelf gain */
+  delta_emphasis_design (&emphasis, DELTA_EMPHASIS_HIGH_SHELF, TEST_RATE,
+      2000.0, -24.0);
+  fail_unless (sine_response (&emphasis, 15000.0, 2.0f) < 1.0 +
+      (plain_high - 1.0) / 8.0);
+
+  delta_emphasis_clear (&emphasis);
+}
+
+GST_END_TEST;
+
+/* Each channel with a gain of its own has to come out as if it had been
+ * run alone with that gain, and channels with a gain of zero have to come
+ * out untouched. */
+static const gfloat channel_gain_sets[][6] = {
+  {1.5f, 0.0f, 2.0f, 0.0f, 0.5f, 1.5f},
+  {1.5f, 1.5f, 1.5f, 1.5f, 1.5f, 1.5f},
+  {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+  {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 2.0f},
+};
+
+GST_START_TEST (test_channel_gains)
+{
+  GRand *rand = g_rand_new_with_seed (RANDOM_SEED);
+  DeltaChannelGains channel_gains;
+  DeltaEmphasis emphasis, mono;
+  const gint nch = 6;
+  guint k, f, g, m, e;
+  gint j, i;
+
+  delta_channel_gains_init (&channel_gains);
+  delta_emphasis_init (&emphasis);
+  delta_emphasis_init (&mono);
+  delta_emphasis_set_channels (&emphasis, nch);
+  delta_emphasis_set_channels (&mono, 1);
+
+  for (k = 0; k < G_N_ELEMENTS (kernels); k++) {
+    const KernelInfo *info = &kernels[k];
+    gint nbytes = info->nbytes;
+
+    for (f = 0; f < G_N_ELEMENTS (test_frames); f++) {
+      gint n_frames = test_frames[f];
+      gint n_samples = n_frames * nch;
+      gsize size = n_samples * nbytes;
+      guint8 *input = g_malloc (size);
+      guint8 *expected = g_malloc (size);
+      guint8 *actual = g_malloc (size);
+      guint8 *channel = g_malloc (n_frames * nbytes);
+
+      info->fill (input, n_samples, nch, PATTERN_RANDOM, rand);
+
+      for (g = 0; g < G_N_ELEMENTS (channel_gain_sets); g++) {
+        delta_channel_gains_set (&channel_gains, nch, 1.0f,
+            channel_gain_sets[g], nch);
+
+        for (e = 0; e < G_N_ELEMENTS (test_emphases); e++) {
+          delta_emphasis_design (&emphasis, test_emphases[e], TEST_RATE,
+              4000.0, -12.0);
+          delta_emphasis_design (&mono, test_emphases[e], TEST_RATE,
+              4000.0, -12.0);
+
+          for (m = 0; m < G_N_ELEMENTS (test_clip_modes); m++) {
+            DeltaClipMode clip_mode = test_clip_modes[m];
+            gint index = -1;
+
+            memcpy (expected, input, size);
+            for (j = 0; j < nch; j++) {
+              if (channel_gain_sets[g][j] == 0.0f)
+                continue;
+              for (i = 0; i < n_frames; i++)
+                memcpy (channel + i * nbytes, input + (i * nch + j) * nbytes,
+                    nbytes);
+              delta_emphasis_reset (&mono);
+              info->reference (channel, n_frames, 1, channel_gain_sets[g][j],
+                  clip_mode, &mono);
+              for (i = 0; i < n_frames; i++)
+                memcpy (expected + (i * nch + j) * nbytes,
+                    channel + i * nbytes, nbytes);
+            }
+
+            memcpy (actual, input, size);
+            delta_emphasis_reset (&emphasis);
+            info->kernel (actual, n_samples, nch, 0.0f, &channel_gains,
+                clip_mode, &emphasis, NULL);
+
+            fail_unless (info->compare (expected, actual, n_samples,
+                    tolerance_for (info, test_emphases[e], clip_mode),
+                    &index),
+                "%s: gains %d, emphasis %d, clip mode %d, %d frames: "
+                "mismatch at sample %d", info->name, g, test_emphases[e],
+                clip_mode, n_frames, index);
+          }
+        }
+      }
+
+      g_free (input);
+      g_free (expected);
+      g_free (actual);
+      g_free (channel);
+    }
+  }
+
+  delta_channel_gains_clear (&channel_gains);
+  delta_emphasis_clear (&emphasis);
+  delta_emphasis_clear (&mono);
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_channel_gains_set)
+{
+  DeltaChannelGains cg;
+  const gfloat gains[] = { 0.0f, 2.0f };
+
+  delta_channel_gains_init (&cg);
+
+  /* channels past the given gains take the default */
+  fail_unless (delta_channel_gains_set (&cg, 4, 0.5f, gains, 2));
+  fail_unless_equals_int (cg.n_active, 3);
+  fail_unless_equals_int (cg.active[0], 1);
+  fail_unless (cg.gains[3] == 0.5f);
+  fail_if (cg.uniform);
+
+  /* a new gain on the same channels is not a change of the active set */
+  fail_if (delta_channel_gains_set (&cg, 4, 1.0f, gains, 2));
+
+  fail_unless (delta_channel_gains_set (&cg, 4, 2.0f, NULL, 0));
+  fail_unless_equals_int (cg.n_active, 4);
+  fail_unless (cg.uniform);
+
+  fail_unless (delta_channel_gains_set (&cg, 4, 0.0f, NULL, 0));
+  fail_unless_equals_int (cg.n_active, 0);
+
+  delta_channel_gains_clear (&cg);
+}
+
+GST_END_TEST;
+
+/* TPDF dither rounds to within 1.5 LSB of the exact result without a
+ * bias, and with first order shaping the errors of successive samples
+ * cancel, so their sum stays within one shaping error of zero. */
+#define DITHER_FRAMES 65536
+
+GST_START_TEST (test_dither)
+{
+  gint16 *samples = g_new (gint16, DITHER_FRAMES);
+  gdouble *exact = g_new (gdouble, DITHER_FRAMES);
+  gfloat floats[2][64];
+  static const gfloat stereo_gains[] = { 0.3f, 0.0f };
+  DeltaChannelGains channel_gains;
+  DeltaDither dither;
+  guint d;
+  gint i;
+
+  delta_dither_init (&dither);
+  delta_dither_set_channels (&dither, 1);
+
+  for (d = 1; d < G_N_ELEMENTS (test_dithers); d++) {
+    gdouble sum = 0.0;
+    gboolean rounded_away = FALSE;
+
+    for (i = 0; i < DITHER_FRAMES; i++)
+      samples[i] = 1000 + (i % 7) - 3;
+    exact[0] = samples[0];
+    for (i = 1; i < DITHER_FRAMES; i++)
+      exact[i] = samples[i] + 0.3f * (gdouble) (samples[i] - samples[i - 1]);
+
+    dither.mode = test_dithers[d];
+    delta_dither_reset (&dither);
+    process16 (samples, DITHER_FRAMES, 1, 0.3f, NULL, DELTA_CLIP_HARD, NULL,
+        &dither);
+
+    fail_unless_equals_int (samples[0], 997);
+    for (i = 1; i < DITHER_FRAMES; i++) {
+      gdouble error = samples[i] - exact[i];
+
+      if (test_dithers[d] == DELTA_DITHER_TPDF)
+        fail_unless (ABS (error) <= 1.5, "sample %d is off by %f", i, error);
+      rounded_away |= ABS (samples[i] - floor (exact[i] + 0.5)) >= 1.0;
+      sum += error;
+    }
+    fail_unless (rounded_away, "dither %d only rounds", test_dithers[d]);
+
+    if (test_dithers[d] == DELTA_DITHER_TPDF)
+      fail_unless (ABS (sum / DITHER_FRAMES) < 0.02, "bias %f",
+          sum / DITHER_FRAMES);
+    else
+      fail_unless (ABS (sum) <= 1.5, "shaped errors sum to %f", sum);
+  }
+
+  /* channels without a gain are not dithered either */
+  delta_channel_gains_init (&channel_gains);
+  delta_channel_gains_set (&channel_gains, 2, 0.0f, stereo_gains, 2);
+  delta_dither_set_channels (&dither, 2);
+  for (d = 1; d < G_N_ELEMENTS (test_dithers); d++) {
+    for (i = 0; i < DITHER_FRAMES; i++)
+      samples[i] = 1000 + (i % 7) - 3;
+    dither.mode = test_dithers[d];
+    delta_dither_reset (&dither);
+    process16 (samples, DITHER_FRAMES, 2, 0.0f, &channel_gains,
+        DELTA_CLIP_HARD, NULL, &dither);
+    for (i = 1; i < DITHER_FRAMES; i += 2)
+      fail_unless_equals_int (samples[i], 1000 + (i % 7) - 3);
+  }
+  delta_channel_gains_clear (&channel_gains);
+
+  /* float samples are left to the sink to quantise */
+  for (i = 0; i < 64; i++)
+    floats[0][i] = floats[1][i] = (i % 5) / 8.0f - 0.25f;
+  dither.mode = DELTA_DITHER_TPDF_SHAPED;
+  processf (floats[0], 64, 1, 0.5f, NULL, DELTA_CLIP_HARD, NULL, &dither);
+  processf (floats[1], 64, 1, 0.5f, NULL, DELTA_CLIP_HARD, NULL, NULL);
+  fail_unless (memcmp (floats[0], floats[1], sizeof (floats[0])) == 0);
+
+  delta_dither_clear (&dither);
+  g_free (samples);
+  g_free (exact);
+}
+
+GST_END_TEST;
+
+static Suite *
+kernels_suite (void)
+{
+  Suite *s = suite_create ("delta kernels");
+  TCase *tc_chain = tcase_create ("conformance");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_random);
+  tcase_add_test (tc_chain, test_full_scale);
+  tcase_add_test (tc_chain, test_silence);
+  tcase_add_test (tc_chain, test_alternating_extremes);
+  tcase_add_test (tc_chain, test_subnormal);
+  tcase_add_test (tc_chain, test_soft_clip_curve);
+  tcase_add_test (tc_chain, test_emphasis_split);
+  tcase_add_test (tc_chain, test_emphasis_response);
+  tcase_add_test (tc_chain, test_channel_gains);
+  tcase_add_test (tc_chain, test_channel_gains_set);
+  tcase_add_test (tc_chain, test_dither);
+
+  return s;
+}
+
+GST_CHECK_MAIN (kernels);
@@ -0,0 +1,284 @@
+/* GStreamer
+ *
+ * performance gate for the delta sample kernels
+ *
+ * Times every kernel in delta.c and compares the result against a baseline
+ * recorded earlier on the same machine.  The baseline file is named by the
+ * DELTA_PERF_BASELINE environment variable; when it does not exist yet, or
+ * was recorded on another host, it is (re)written and the run passes.
+ * Kernels that are not in the baseline yet are appended to it.  The
+ * run fails when a kernel is slower than the baseline by more than
+ * DELTA_PERF_THRESHOLD (a fraction, 0.25 by default).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <gst/gst.h>
+
+#include "delta.h"
+
+#define DEFAULT_THRESHOLD 0.25
+
+#define N_CHANNELS 2
+#define N_SAMPLES (N_CHANNELS * 32768)
+#define N_CALLS 16
+#define N_RUNS 7
+
+typedef gpointer (*KernelFunc) (void *buf, gint n_samples, gint nch,
+    gfloat gain, const DeltaChannelGains * channel_gains,
+    DeltaClipMode clip_mode, DeltaEmphasis * emphasis, DeltaDither * dither);
+
+typedef struct
+{
+  const gchar *name;
+  gint nbytes;
+  gboolean is_float;
+  KernelFunc kernel;
+  DeltaClipMode clip_mode;
+  DeltaEmphasisType emphasis;
+  DeltaDitherMode dither;
+  const gfloat *channel_gains;  /* [N_CHANNELS] or NULL */
+} KernelInfo;
+
+/* /channel-gains turns the second channel off, so that the plain loop
+ * runs over the lanes of the channel gains */
+static const gfloat one_channel[N_CHANNELS] = { 1.5f, 0.0f };
+
+/* /tpdf runs in the plain loop and /dither, which is shaped, in the
+ * forward loop.  The float kernels ignore dither, so their entries
+ * measure the check that skips it */
+#define KERNEL(func, type, is_float) \
+  { #func, sizeof (type), is_float, (KernelFunc) func, DELTA_CLIP_HARD, \
+    DELTA_EMPHASIS_NONE, DELTA_DITHER_NONE, NULL }, \
+  { #func "/soft", sizeof (type), is_float, (KernelFunc) func, \
+    DELTA_CLIP_SOFT, DELTA_EMPHASIS_NONE, DELTA_DITHER_NONE, NULL }, \
+  { #func "/low-pass", sizeof (type), is_float, (KernelFunc) func, \
+    DELTA_CLIP_HARD, DELTA_EMPHASIS_LOW_PASS, DELTA_DITHER_NONE, NULL }, \
+  { #func "/tpdf", sizeof (type), is_float, (KernelFunc) func, \
+    DELTA_CLIP_HARD, DELTA_EMPHASIS_NONE, DELTA_DITHER_TPDF, NULL }, \
+  { #func "/dither", sizeof (type), is_float, (KernelFunc) func, \
+    DELTA_CLIP_HARD, DELTA_EMPHASIS_NONE, DELTA_DITHER_TPDF_SHAPED, NULL }, \
+  { #func "/channel-gains", sizeof (type), is_float, (KernelFunc) func, \
+    DELTA_CLIP_HARD, DELTA_EMPHASIS_NONE, DELTA_DITHER_NONE, one_channel }
+
+static const KernelInfo kernels[] = {
+  KERNEL (process8, gint8, FALSE),
+  KERNEL (process8u, guint8, FALSE),
+  KERNEL (process16, gint16, FALSE),
+  KERNEL (process16u, guint16, FALSE),
+  KERNEL (process32, gint32, FALSE),
+  KERNEL (process32u, guint32, FALSE),
+  KERNEL (process64, gint64, FALSE),
+  KERNEL (process64u, guint64, FALSE),
+  KERNEL (processf, gfloat, TRUE),
+  KERNEL (processd, gdouble, TRUE),
+};
+
+static void
+fill_input (const KernelInfo * info, guint8 * data, GRand * rand)
+{
+  gint i;
+
+  if (info->nbytes == sizeof (gfloat) && info->is_float) {
+    for (i = 0; i < N_SAMPLES; i++)
+      ((gfloat *) data)[i] = g_rand_double_range (rand, -1.0, 1.0);
+  } else if (info->is_float) {
+    for (i = 0; i < N_SAMPLES; i++)
+      ((gdouble *) data)[i] = g_rand_double_range (rand, -1.0, 1.0);
+  } else {
+    for (i = 0; i < N_SAMPLES * info->nbytes; i++)
+      data[i] = g_rand_int (rand);
+  }
+}
+
+/* best of N_RUNS, in nanoseconds per sample.  The input is restored before
+ * every call so that repeated sharpening does not drift into clipping or
+ * denormals, which would change what is being measured. */
+static gdouble
+measure (const KernelInfo * info, GRand * rand)
+{
+  gsize size = N_SAMPLES * info->nbytes;
+  guint8 *input = g_malloc (size);
+  guint8 *work = g_malloc (size);
+  gdouble best = G_MAXDOUBLE;
+  DeltaChannelGains channel_gains;
+  DeltaEmphasis emphasis;
+  DeltaDither dither;
+  gint run, call;
+
+  fill_input (info, input, rand);
+
+  delta_channel_gains_init (&channel_gains);
+  if (info->channel_gains != NULL)
+    delta_channel_gains_set (&channel_gains, N_CHANNELS, 1.5f,
+        info->channel_gains, N_CHANNELS);
+
+  delta_emphasis_init (&emphasis);
+  delta_emphasis_set_channels (&emphasis, N_CHANNELS);
+  delta_emphasis_design (&emphasis, info->emphasis, 48000.0, 6000.0, -12.0);
+  delta_dither_init (&dither);
+  delta_dither_set_channels (&dither, N_CHANNELS);
+  dither.mode = info->dither;
+
+  for (run = 0; run < N_RUNS; run++) {
+    gint64 elapsed = 0;
+
+    for (call = 0; call < N_CALLS; call++) {
+      gint64 start;
+
+      memcpy (work, input, size);
+      delta_emphasis_reset (&emphasis);
+      delta_dither_reset (&dither);
+      start = g_get_monotonic_time ();
+      info->kernel (work, N_SAMPLES, N_CHANNELS, 1.5f,
+          info->channel_gains != NULL ? &channel_gains : NULL,
+          info->clip_mode, &emphasis, &dither);
+      elapsed += g_get_monotonic_time () - start;
+    }
+    best = MIN (best, elapsed * 1000.0 / ((gdouble) N_CALLS * N_SAMPLES));
+  }
+
+  delta_channel_gains_clear (&channel_gains);
+  delta_emphasis_clear (&emphasis);
+  delta_dither_clear (&dither);
+  g_free (input);
+  g_free (work);
+
+  return best;
+}
+
+/* the baseline is a "host <name>" line followed by "<kernel> <ns>" lines */
+static GHashTable *
+read_baseline (const gchar * filename)
+{
+  GHashTable *baseline;
+  gchar *contents, **lines, **line;
+
+  if (!g_file_get_contents (filename, &contents, NULL, NULL))
+    return NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  if (lines[0] == NULL || !g_str_has_prefix (lines[0], "host ")
+      || strcmp (lines[0] + 5, g_get_host_name ()) != 0) {
+    g_print ("baseline %s was recorded on another host\n", filename);
+    g_strfreev (lines);
+    return NULL;
+  }
+
+  baseline = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  for (line = lines + 1; *line != NULL; line++) {
+    gchar **fields = g_strsplit (*line, " ", 2);
+
+    if (fields[0] != NULL && fields[1] != NULL) {
+      gdouble *value = g_new (gdouble, 1);
+
+      *value = g_ascii_strtod (fields[1], NULL);
+      g_hash_table_insert (baseline, g_strdup (fields[0]), value);
+    }
+    g_strfreev (fields);
+  }
+  g_strfreev (lines);
+
+  return baseline;
+}
+
+static gboolean
+write_baseline (const gchar * filename, const gdouble * results)
+{
+  GString *contents = g_string_new (NULL);
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+  GError *error = NULL;
+  guint k;
+
+  g_string_append_printf (contents, "host %s\n", g_get_host_name ());
+  for (k = 0; k < G_N_ELEMENTS (kernels); k++) {
+    g_string_append_printf (contents, "%s %s\n", kernels[k].name,
+        g_ascii_dtostr (buf, sizeof (buf), results[k]));
+  }
+
+  if (!g_file_set_contents (filename, contents->str, -1, &error)) {
+    g_printerr ("could not write baseline %s: %s\n", filename,
+        error->message);
+    g_error_free (error);
+    g_string_free (contents, TRUE);
+    return FALSE;
+  }
+
+  g_print ("recorded baseline %s\n", filename);
+  g_string_free (contents, TRUE);
+  return TRUE;
+}
+
+int
+main (int argc, char **argv)
+{
+  const gchar *filename = g_getenv ("DELTA_PERF_BASELINE");
+  const gchar *threshold_env = g_getenv ("DELTA_PERF_THRESHOLD");
+  gdouble threshold = DEFAULT_THRESHOLD;
+  gdouble results[G_N_ELEMENTS (kernels)];
+  gdouble recorded[G_N_ELEMENTS (kernels)];
+  GHashTable *baseline = NULL;
+  GRand *rand;
+  gboolean complete = TRUE;
+  gboolean failed = FALSE;
+  guint k;
+
+  if (threshold_env != NULL)
+    threshold = g_ascii_strtod (threshold_env, NULL);
+
+  if (filename != NULL)
+    baseline = read_baseline (filename);
+
+  rand = g_rand_new_with_seed (0x64656c74);
+
+  for (k = 0; k < G_N_ELEMENTS (kernels); k++) {
+    gdouble *reference = NULL;
+
+    results[k] = measure (&kernels[k], rand);
+    recorded[k] = results[k];
+
+    if (baseline != NULL)
+      reference = g_hash_table_lookup (baseline, kernels[k].name);
+
+    if (reference == NULL) {
+      g_print ("%-20s %8.3f ns/sample\n", kernels[k].name, results[k]);
+      complete = FALSE;
+    } else {
+      gboolean regressed = results[k] > *reference * (1.0 + threshold);
+
+      recorded[k] = *reference;
+
+      g_print ("%-20s %8.3f ns/sample (baseline %.3f)%s\n", kernels[k].name,
+          results[k], *reference, regressed ? " REGRESSED" : "");
+      failed |= regressed;
+    }
+  }
+
+  g_rand_free (rand);
+
+  if (baseline != NULL)
+    g_hash_table_destroy (baseline);
+
+  /* kernels missing from the baseline are added, the others are kept */
+  if (filename != NULL && !complete && !write_baseline (filename, recorded))
+    failed = TRUE;
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}